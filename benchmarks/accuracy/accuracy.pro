@@ -0,0 +1,68 @@
+# Author: Jakub Precht
+
+# set according to your setup
+ESSENTIA_PATH = /opt/essentia
+MIDIFILE_PATH = /opt/midifile
+
+# not a testcase, "make check" runs it against melody-baseline.json with 10% margin; after an intended change
+# of results record it again with: accuracy-harness --record-baseline melody-baseline.json
+TARGET = accuracy-harness
+CONFIG += c++14 console
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -O2 -Wall -Wshadow -Wpedantic -Wextra
+
+QT += core widgets multimedia concurrent
+
+DEFINES += SETTINGS_FILE=\\\"$$PWD/../../other/settings.json\\\"
+DEFINES += DEFAULT_SCORE=\\\"$$PWD/melody.txt\\\"
+
+INCLUDEPATH += ../../include
+
+HEADERS += \
+    ../../include/audiolog.h \
+    ../../include/channelfollower.h \
+    ../../include/latency.h \
+    ../../include/metrics.h \
+    ../../include/musicxmlreader.h \
+    ../../include/pitchquantizer.h \
+    ../../include/recorder.h \
+    ../../include/resampler.h \
+    ../../include/scorefile.h \
+    ../../include/scoremodel.h \
+    ../../include/scorereader.h \
+    ../../include/settings.h \
+    ../../include/trace.h
+
+SOURCES += \
+    accuracyharness.cpp \
+    ../../src/audiolog.cpp \
+    ../../src/channelfollower.cpp \
+    ../../src/latency.cpp \
+    ../../src/metrics.cpp \
+    ../../src/musicxmlreader.cpp \
+    ../../src/pitchquantizer.cpp \
+    ../../src/recorder.cpp \
+    ../../src/resampler.cpp \
+    ../../src/scorefile.cpp \
+    ../../src/scoremodel.cpp \
+    ../../src/scorereader.cpp \
+    ../../src/settings.cpp \
+    ../../src/trace.cpp
+
+# essentia
+LIBS += -L$$ESSENTIA_PATH/build/src/ -lessentia -lfftw3f -lavformat -lavcodec -lavutil -lavresample -lsamplerate -ltag -lyaml -lchromaprint
+INCLUDEPATH += $$ESSENTIA_PATH/src/essentia/
+DEPENDPATH += $$ESSENTIA_PATH/src/essentia/
+PRE_TARGETDEPS += $$ESSENTIA_PATH/build/src/libessentia.a
+
+# midifile
+LIBS += -L$$MIDIFILE_PATH/lib/ -lmidifile
+INCLUDEPATH += $$MIDIFILE_PATH/include
+DEPENDPATH += $$MIDIFILE_PATH/include
+PRE_TARGETDEPS += $$MIDIFILE_PATH/lib/libmidifile.a
+
+# zlib, for compressed MusicXML
+LIBS += -lz
+
+check.commands = $$OUT_PWD/$$TARGET --baseline $$PWD/melody-baseline.json
+QMAKE_EXTRA_TARGETS += check
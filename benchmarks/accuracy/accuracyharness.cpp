@@ -0,0 +1,480 @@
+// Author:  Jakub Precht
+
+#include "audiolog.h"
+#include "latency.h"
+#include "latestvalue.h"
+#include "recorder.h"
+#include "scorereader.h"
+#include "settings.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QAudioBuffer>
+#include <QTextStream>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+// Renders a score into audio as a (slightly wrong) performance and runs it through the follower offline,
+// buffer by buffer, as the recorder would get it from audio input. Performance changes tempo, plays wrong
+// notes, skips chords and is mixed with noise, all drawn from a seeded generator so runs are repeatable.
+// Reported are alignment accuracy (share of buffers after which follower is within tolerance of the chord
+// being played) and detection latency of every chord (audio time from its onset until follower reaches
+// it). Exit code is 1 when any of them is worse than its threshold. Thresholds are given on command line or
+// derived with a margin from a baseline file recorded by an earlier run of the same scenario and settings;
+// audio time is simulated, so a run is repeatable and the margin only covers differences of builds.
+class AccuracyHarness
+{
+public:
+    struct Options
+    {
+        QString score;
+        QString notes_output;
+        double tempo_changes = 0.1; // probability of tempo change at every chord
+        double tempo_range = 1.2; // tempo stays within score tempo divided or multiplied by it
+        double wrong_notes = 0.02; // probability of playing a neighbouring note instead
+        double skips = 0.02; // probability of skipping a chord
+        double noise = 0.01; // standard deviation of white noise, full scale is 1
+        unsigned int seed = 1;
+        int input_rate = 0; // of synthesized audio, resampled by follower; 0 for analysis rate
+        int tolerance = 1; // chords follower may be off and still count as aligned
+        // thresholds, negative ones are taken from baseline or not checked
+        double min_accuracy = -1;
+        double max_latency = -1; // 95th percentile, in ms
+        double max_missed = -1; // share of played chords follower never reached
+        QString baseline; // file results are compared with
+        QString record_baseline; // file results are written to
+        double baseline_margin = 0.1; // relative, results may be that much worse than baseline
+    };
+
+    AccuracyHarness(const Options &options, const SettingsPointer &settings);
+    int run(); // 0 when within thresholds, 1 when not, -1 on error
+
+private:
+    struct PlayedNote
+    {
+        int group;
+        int pitch;
+        int velocity;
+        double onset; // in seconds of performance
+        double duration;
+    };
+
+    void perform();
+    int inputRate() const;
+    std::vector<float> synthesize();
+    void follow(const std::vector<float> &audio);
+
+    struct Results
+    {
+        double accuracy;
+        double latency; // 95th percentile, in ms
+        double missed; // share of played chords
+    };
+
+    bool report() const;
+    bool check(const Results &results) const;
+    bool readBaseline(Options &thresholds) const;
+    bool writeBaseline(const Results &results) const;
+    QString scenario() const;
+    bool writeNotes() const;
+
+    // ----------
+
+    Options m_options;
+    SettingsPointer m_settings;
+    ScorePointer m_score;
+    std::mt19937 m_random;
+
+    QVector<PlayedNote> m_played_notes;
+    QVector<int> m_played_groups;
+    QVector<double> m_group_onsets; // by chord group, -1 for skipped ones
+    QVector<double> m_latencies; // by chord group, -1 until follower reaches it
+    int m_wrong_notes = 0;
+    double m_length = 0; // of performance, in seconds
+    double m_accuracy = 0;
+
+    static constexpr double m_lead_in = 1; // s of noise before first and after last note
+    static constexpr double m_attack = 0.005; // s
+    static constexpr double m_release = 0.03; // s
+    static constexpr double m_decay = 1.2; // of fundamental, per second
+    static constexpr double m_partial_decay = 0.6; // added for each next partial
+    static constexpr double m_inharmonicity = 0.0004; // of a piano string
+    static const int m_partials = 8;
+    static const int m_buffer_size = 1024; // samples, as audio input delivers them
+};
+
+AccuracyHarness::AccuracyHarness(const Options &options, const SettingsPointer &settings)
+    : m_options(options), m_settings(settings), m_random(options.seed)
+{
+}
+
+int AccuracyHarness::run()
+{
+    m_score = ScoreReader::readScoreFile(m_options.score);
+    if (m_score->isEmpty()) {
+        qWarning().nospace() << "No notes read from " << m_options.score << ".";
+        return -1;
+    }
+
+    perform();
+    follow(synthesize());
+    if (!m_options.notes_output.isEmpty() && !writeNotes())
+        return -1;
+    return report() ? 0 : 1;
+}
+
+void AccuracyHarness::perform()
+{
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::uniform_real_distribution<double> tempo_exponent(-std::log(m_options.tempo_range), std::log(m_options.tempo_range));
+    const qint64 *onsets = m_score->onsets();
+    const qint32 *durations = m_score->durations();
+    const quint8 *pitches = m_score->pitches();
+    const quint8 *velocities = m_score->velocities();
+    const qint32 *groups = m_score->chordGroups();
+    const int size = m_score->size();
+
+    m_group_onsets.fill(-1, groups[size - 1] + 1);
+    double tempo = 1; // relative to score
+    double time = m_lead_in;
+    for (int first = 0, last = 0; first < size; first = last) {
+        const int group = groups[first];
+        const double score_onset = m_score->seconds(onsets[first]);
+        double group_end = score_onset;
+        for (last = first; last < size && groups[last] == group; last++)
+            group_end = qMax(group_end, m_score->seconds(onsets[last] + durations[last]));
+        const double next_onset = last < size ? m_score->seconds(onsets[last]) : group_end;
+
+        if (uniform(m_random) < m_options.tempo_changes)
+            tempo = std::exp(tempo_exponent(m_random));
+        if (group > 0 && uniform(m_random) < m_options.skips)
+            continue; // performer jumps over it, so it takes no time
+
+        m_group_onsets[group] = time;
+        m_played_groups.push_back(group);
+        for (int note = first; note < last; note++) {
+            int pitch = pitches[note];
+            if (uniform(m_random) < m_options.wrong_notes) {
+                pitch += (uniform(m_random) < 0.5 ? -1 : 1) * (uniform(m_random) < 0.5 ? 1 : 2);
+                m_wrong_notes++;
+            }
+            const double duration = (m_score->seconds(onsets[note] + durations[note]) - score_onset) / tempo;
+            m_played_notes.push_back({ group, pitch, velocities[note], time, duration });
+        }
+        time += (next_onset - score_onset) / tempo;
+    }
+    m_length = time + m_lead_in;
+}
+
+int AccuracyHarness::inputRate() const
+{
+    return m_options.input_rate > 0 ? m_options.input_rate : m_settings->sampleRate();
+}
+
+std::vector<float> AccuracyHarness::synthesize()
+{
+    // additive piano-like tone: stretched partials, each decaying faster than the one below
+    const int sample_rate = inputRate();
+    const size_t attack = static_cast<size_t>(m_attack * sample_rate);
+    const size_t release = static_cast<size_t>(m_release * sample_rate);
+    std::vector<float> audio(static_cast<size_t>(std::ceil(m_length * sample_rate)), 0.f);
+    for (auto &note : m_played_notes) {
+        const double frequency = 440 * std::pow(2, (note.pitch - 69) / 12.0);
+        const size_t begin = static_cast<size_t>(note.onset * sample_rate);
+        const size_t sustain = static_cast<size_t>(note.duration * sample_rate);
+        const size_t end = qMin(audio.size(), begin + sustain + release);
+        for (int k = 1; k <= m_partials; k++) {
+            const double partial = k * frequency * std::sqrt(1 + m_inharmonicity * k * k);
+            if (partial >= sample_rate / 2)
+                break;
+            const double step = 2 * M_PI * partial / sample_rate;
+            const double decay = std::exp(-(m_decay + m_partial_decay * (k - 1)) / sample_rate);
+            double gain = 0.2 * note.velocity / 127 / k;
+            for (size_t i = begin; i < end; i++) {
+                const size_t t = i - begin;
+                double envelope = gain;
+                if (t < attack)
+                    envelope *= static_cast<double>(t) / attack;
+                if (t > sustain)
+                    envelope *= 1 - static_cast<double>(t - sustain) / release;
+                audio[i] += static_cast<float>(envelope * std::sin(step * t));
+                gain *= decay;
+            }
+        }
+    }
+
+    std::normal_distribution<float> noise(0, static_cast<float>(m_options.noise));
+    for (auto &sample : audio)
+        sample = qBound(-1.f, sample + noise(m_random), 1.f);
+    return audio;
+}
+
+void AccuracyHarness::follow(const std::vector<float> &audio)
+{
+    LatestValue<int> position;
+    LatestValue<qint64> position_time;
+    LatestValue<float> level;
+    LoadedScore loaded;
+    loaded.score = m_score;
+    loaded.rows->dtw_row.fill(0, m_score->size());
+    loaded.rows->next_row.fill(0, m_score->size());
+
+    SettingsSource settings_source;
+    settings_source.publish(m_settings);
+    Recorder recorder;
+    recorder.setSettingsSource(&settings_source);
+    recorder.setOutputs(&position, &position_time, &level);
+    recorder.setScore(loaded);
+    recorder.startFollowing();
+
+    QAudioFormat format;
+    format.setChannelCount(1);
+    format.setSampleRate(inputRate());
+    format.setSampleSize(32);
+    format.setSampleType(QAudioFormat::Float);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setCodec("audio/pcm");
+
+    const qint32 *groups = m_score->chordGroups();
+    m_latencies.fill(-1, m_group_onsets.size());
+    int follower_group = -1;
+    int started = 0; // played groups with onset before current time
+    int reached = 0; // played groups follower got to
+    int aligned = 0;
+    int measured = 0;
+    for (size_t begin = 0; begin < audio.size(); begin += m_buffer_size) {
+        const size_t end = qMin(audio.size(), begin + m_buffer_size);
+        const QByteArray data(reinterpret_cast<const char *>(audio.data() + begin),
+                              static_cast<int>((end - begin) * sizeof(float)));
+        recorder.processBuffer(QAudioBuffer(data, format));
+
+        int value = 0;
+        if (position.take(value))
+            follower_group = value > 0 ? groups[value - 1] : -1;
+
+        const double time = static_cast<double>(end) / inputRate();
+        while (started < m_played_groups.size() && m_group_onsets[m_played_groups[started]] <= time)
+            started++;
+        if (started == 0)
+            continue;
+
+        measured++;
+        if (qAbs(follower_group - m_played_groups[started - 1]) <= m_options.tolerance)
+            aligned++;
+        for (; reached < started && follower_group >= m_played_groups[reached]; reached++)
+            m_latencies[m_played_groups[reached]] = time - m_group_onsets[m_played_groups[reached]];
+    }
+    m_accuracy = measured > 0 ? static_cast<double>(aligned) / measured : 0;
+}
+
+bool AccuracyHarness::report() const
+{
+    QVector<double> latencies; // in ms, of reached groups
+    for (int group : m_played_groups) {
+        if (m_latencies[group] >= 0)
+            latencies.push_back(m_latencies[group] * 1000);
+        else
+            qDebug().nospace() << "Chord " << group << " at " << m_group_onsets[group] << " s was never reached.";
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.isEmpty() ? 0 : latencies[qMin(latencies.size() - 1, static_cast<int>(p * latencies.size()))];
+    };
+    const int missed = m_played_groups.size() - latencies.size();
+    const double missed_share = m_played_groups.isEmpty() ? 0 : static_cast<double>(missed) / m_played_groups.size();
+
+    qInfo().nospace() << "Played " << m_played_groups.size() << " of " << m_group_onsets.size() << " chords in "
+                      << m_length << " s with " << m_wrong_notes << " wrong notes.";
+    qInfo().nospace() << "Alignment accuracy: " << m_accuracy << " (within " << m_options.tolerance << " chords).";
+    qInfo().nospace() << "Detection latency: p50 " << percentile(0.5) << " ms, p95 " << percentile(0.95)
+                      << " ms, max " << (latencies.isEmpty() ? 0 : latencies.last()) << " ms, "
+                      << missed << " chords missed.";
+    qDebug().noquote() << "Processing time:\n" << Latency::report();
+
+    const Results results = { m_accuracy, percentile(0.95), missed_share };
+    if (!m_options.record_baseline.isEmpty())
+        return writeBaseline(results);
+    return check(results);
+}
+
+bool AccuracyHarness::check(const Results &results) const
+{
+    Options thresholds = m_options;
+    if (!m_options.baseline.isEmpty() && !readBaseline(thresholds))
+        return false;
+
+    bool passed = true;
+    if (thresholds.min_accuracy >= 0 && results.accuracy < thresholds.min_accuracy) {
+        qWarning().nospace() << "Accuracy " << results.accuracy << " is below " << thresholds.min_accuracy << ".";
+        passed = false;
+    }
+    if (thresholds.max_latency >= 0 && results.latency > thresholds.max_latency) {
+        qWarning().nospace() << "Latency " << results.latency << " ms is above " << thresholds.max_latency << " ms.";
+        passed = false;
+    }
+    if (thresholds.max_missed >= 0 && results.missed > thresholds.max_missed) {
+        qWarning().nospace() << "Missed " << results.missed << " of chords, more than " << thresholds.max_missed << ".";
+        passed = false;
+    }
+    return passed;
+}
+
+bool AccuracyHarness::readBaseline(Options &thresholds) const
+{
+    QFile file(m_options.baseline);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning().nospace().noquote() << "No baseline at " << m_options.baseline
+                                       << ", record it with --record-baseline on the default scenario.";
+        return false;
+    }
+    const QJsonObject baseline = QJsonDocument::fromJson(file.readAll()).object();
+    if (baseline.value("scenario").toString() != scenario()) {
+        qWarning().nospace().noquote() << "Baseline " << m_options.baseline << " was recorded for another scenario: "
+                                       << baseline.value("scenario").toString() << ".";
+        return false;
+    }
+
+    // explicit thresholds win; missed chords get one chord more, as baseline often misses none
+    const double margin = m_options.baseline_margin;
+    if (thresholds.min_accuracy < 0)
+        thresholds.min_accuracy = baseline.value("accuracy").toDouble() * (1 - margin);
+    if (thresholds.max_latency < 0)
+        thresholds.max_latency = baseline.value("latency").toDouble() * (1 + margin);
+    if (thresholds.max_missed < 0)
+        thresholds.max_missed = baseline.value("missed").toDouble() * (1 + margin) + 1.0 / qMax(1, m_played_groups.size());
+    return true;
+}
+
+bool AccuracyHarness::writeBaseline(const Results &results) const
+{
+    QJsonObject baseline;
+    baseline.insert("scenario", scenario());
+    baseline.insert("accuracy", results.accuracy);
+    baseline.insert("latency", results.latency);
+    baseline.insert("missed", results.missed);
+
+    QSaveFile file(m_options.record_baseline);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open: " << m_options.record_baseline;
+        return false;
+    }
+    file.write(QJsonDocument(baseline).toJson());
+    if (!file.commit()) {
+        qWarning() << "Failed to write: " << m_options.record_baseline;
+        return false;
+    }
+    qInfo().noquote() << "Baseline recorded to" << m_options.record_baseline;
+    return true;
+}
+
+QString AccuracyHarness::scenario() const
+{
+    // everything that changes results except settings, which have to be the repository ones
+    return QString("%1 tempo-changes %2 tempo-range %3 wrong-notes %4 skips %5 noise %6 seed %7 input-rate %8 "
+                   "tolerance %9").arg(QFileInfo(m_options.score).fileName()).arg(m_options.tempo_changes)
+            .arg(m_options.tempo_range).arg(m_options.wrong_notes).arg(m_options.skips).arg(m_options.noise)
+            .arg(m_options.seed).arg(m_options.input_rate).arg(m_options.tolerance);
+}
+
+bool AccuracyHarness::writeNotes() const
+{
+    QSaveFile file(m_options.notes_output);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open: " << m_options.notes_output;
+        return false;
+    }
+    QTextStream out(&file);
+    out << "chord,onset_s,pitch,latency_ms\n"; // latency of -1 means follower never reached the chord
+    for (auto &note : m_played_notes) {
+        const double latency = m_latencies[note.group];
+        out << note.group << ',' << note.onset << ',' << note.pitch << ','
+            << (latency >= 0 ? latency * 1000 : -1) << '\n';
+    }
+    out.flush();
+    if (!file.commit()) {
+        qWarning() << "Failed to write: " << m_options.notes_output;
+        return false;
+    }
+    return true;
+}
+
+static bool s_verbose = false;
+static QtMessageHandler s_default_handler = nullptr;
+
+// follower reports every detected note, which only matters when looking into single run
+static void filterMessages(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    if (s_verbose || (type != QtDebugMsg && !message.startsWith("Detected note")
+                      && !message.startsWith("Started score following")))
+        s_default_handler(type, context, message);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Plays synthesized performance of score to follower and checks how well it follows.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("score", "Score in any supported format, melody.txt by default.", "[score]");
+
+    AccuracyHarness::Options options;
+    auto add_value = [&](const QString &name, const QString &description, double default_value) {
+        parser.addOption(QCommandLineOption(name, QString("%1 (%2).").arg(description).arg(default_value),
+                                            "value", QString::number(default_value)));
+    };
+    add_value("tempo-changes", "Probability of tempo change at a chord", options.tempo_changes);
+    add_value("tempo-range", "Largest ratio of performed and written tempo", options.tempo_range);
+    add_value("wrong-notes", "Probability of playing a wrong note", options.wrong_notes);
+    add_value("skips", "Probability of skipping a chord", options.skips);
+    add_value("noise", "Standard deviation of white noise, full scale is 1", options.noise);
+    add_value("seed", "Seed of random generator", options.seed);
+    add_value("input-rate", "Sample rate of audio input in Hz, 0 for sampleRate of settings", options.input_rate);
+    add_value("tolerance", "Chords follower may be off by and still be aligned", options.tolerance);
+    add_value("min-accuracy", "Lowest acceptable alignment accuracy, negative for none", options.min_accuracy);
+    add_value("max-latency", "Highest acceptable 95th percentile of detection latency in ms, negative for none",
+              options.max_latency);
+    add_value("max-missed", "Highest acceptable share of chords never reached, negative for none", options.max_missed);
+    add_value("baseline-margin", "Share by which results may be worse than baseline", options.baseline_margin);
+    parser.addOption(QCommandLineOption("baseline", "Compare results with baseline recorded earlier.", "file"));
+    parser.addOption(QCommandLineOption("record-baseline", "Write results as baseline, checking nothing.", "file"));
+    parser.addOption(QCommandLineOption("settings", "Settings file (repository one).", "file", SETTINGS_FILE));
+    parser.addOption(QCommandLineOption("notes", "Write detection latency of every played note as csv.", "file"));
+    parser.addOption(QCommandLineOption({ "v", "verbose" }, "Print every detection and processing times."));
+    parser.process(app);
+
+    options.score = parser.positionalArguments().value(0, DEFAULT_SCORE);
+    options.notes_output = parser.value("notes");
+    options.tempo_changes = parser.value("tempo-changes").toDouble();
+    options.tempo_range = qMax(1.0, parser.value("tempo-range").toDouble());
+    options.wrong_notes = parser.value("wrong-notes").toDouble();
+    options.skips = parser.value("skips").toDouble();
+    options.noise = parser.value("noise").toDouble();
+    options.seed = parser.value("seed").toUInt();
+    options.input_rate = qMax(0, parser.value("input-rate").toInt());
+    options.tolerance = parser.value("tolerance").toInt();
+    options.min_accuracy = parser.value("min-accuracy").toDouble();
+    options.max_latency = parser.value("max-latency").toDouble();
+    options.max_missed = parser.value("max-missed").toDouble();
+    options.baseline_margin = parser.value("baseline-margin").toDouble();
+    options.baseline = parser.value("baseline");
+    options.record_baseline = parser.value("record-baseline");
+
+    s_verbose = parser.isSet("verbose");
+    s_default_handler = qInstallMessageHandler(filterMessages);
+
+    auto settings = std::make_shared<Settings>();
+    if (!settings->readSettings(parser.value("settings")))
+        return -1;
+    AccuracyHarness harness(options, settings);
+    AudioLog::start();
+    const int result = harness.run();
+    AudioLog::stop();
+    return result;
+}
@@ -0,0 +1,16 @@
+# Author: Jakub Precht
+
+# Benchmarks of hot parts of the follower, built separately from the application:
+#   qmake benchmarks/benchmarks.pro && make && make check TESTARGS="-csv"
+# Every benchmark is a QtTest executable, so -csv, -xml or "-o results.xml,xml" give machine readable
+# results and -tickcounter or -perf (linux) switch the measurement from wall time.
+# accuracy is not a QtTest one, it plays synthesized performance to the follower and reports accuracy and
+# detection latency; its "make check" fails when they are worse than recorded baseline, see accuracy.pro.
+# output is a test rather than a benchmark, local clients check position published over OSC and WebSocket.
+
+TEMPLATE = subdirs
+SUBDIRS += \
+    accuracy \
+    kernels \
+    musicxml \
+    output
@@ -0,0 +1,50 @@
+# Author: Jakub Precht
+
+# set according to your setup
+ESSENTIA_PATH = /opt/essentia
+
+TARGET = kernels-benchmark
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -O2 -Wall -Wshadow -Wpedantic -Wextra
+
+QT += core gui widgets multimedia svg concurrent testlib
+
+DEFINES += SETTINGS_FILE=\\\"$$PWD/../../other/settings.json\\\"
+
+INCLUDEPATH += ../../include
+
+HEADERS += \
+    ../../include/audiolog.h \
+    ../../include/channelfollower.h \
+    ../../include/latency.h \
+    ../../include/lilypond.h \
+    ../../include/lilypondserver.h \
+    ../../include/metrics.h \
+    ../../include/pitchquantizer.h \
+    ../../include/recorder.h \
+    ../../include/resampler.h \
+    ../../include/scoremodel.h \
+    ../../include/settings.h \
+    ../../include/trace.h
+
+SOURCES += \
+    kernelsbenchmark.cpp \
+    ../../src/audiolog.cpp \
+    ../../src/channelfollower.cpp \
+    ../../src/latency.cpp \
+    ../../src/lilypond.cpp \
+    ../../src/lilypondserver.cpp \
+    ../../src/metrics.cpp \
+    ../../src/pitchquantizer.cpp \
+    ../../src/recorder.cpp \
+    ../../src/resampler.cpp \
+    ../../src/scoremodel.cpp \
+    ../../src/settings.cpp \
+    ../../src/trace.cpp
+
+# essentia
+LIBS += -L$$ESSENTIA_PATH/build/src/ -lessentia -lfftw3f -lavformat -lavcodec -lavutil -lavresample -lsamplerate -ltag -lyaml -lchromaprint
+INCLUDEPATH += $$ESSENTIA_PATH/src/essentia/
+DEPENDPATH += $$ESSENTIA_PATH/src/essentia/
+PRE_TARGETDEPS += $$ESSENTIA_PATH/build/src/libessentia.a
@@ -0,0 +1,239 @@
+// Author:  Jakub Precht
+
+#include "channelfollower.h"
+#include "recorder.h"
+#include "lilypond.h"
+#include "pitchquantizer.h"
+#include "settings.h"
+
+#include <QtTest>
+#include <QAudioBuffer>
+#include <QPainter>
+#include <QRegularExpression>
+#include <QTemporaryDir>
+
+#include <cmath>
+
+// Kernels of the audio and render paths run on their own, through friend access to the real code. Every
+// benchmark is parameterized by what its cost depends on: score length, sample format, frame size and
+// number of pages.
+class KernelsBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void calculatePosition_data();
+    void calculatePosition();
+    void convertBufferToAudio_data();
+    void convertBufferToAudio();
+    void quantizePitch_data();
+    void quantizePitch();
+    void frameChain_data();
+    void frameChain();
+    void calculateIndicatorYs_data();
+    void calculateIndicatorYs();
+
+private:
+    SettingsPointer readSettings(int frame_size = 0);
+    QImage drawPage() const;
+
+    QTemporaryDir m_directory;
+    SettingsPointer m_settings;
+};
+
+void KernelsBenchmark::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+    m_settings = readSettings();
+    QVERIFY(m_settings != nullptr);
+}
+
+SettingsPointer KernelsBenchmark::readSettings(int frame_size)
+{
+    // repository settings, optionally with another frame size
+    QFile file(SETTINGS_FILE);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return nullptr;
+    QString content = QString::fromUtf8(file.readAll());
+    if (frame_size > 0)
+        content.replace(QRegularExpression("\"frameSize\":[^,]*,"), QString("\"frameSize\": %1,").arg(frame_size));
+
+    const QString filename = m_directory.filePath(QString("settings-%1.json").arg(frame_size));
+    QFile copy(filename);
+    if (!copy.open(QIODevice::WriteOnly | QIODevice::Text))
+        return nullptr;
+    copy.write(content.toUtf8());
+    copy.close();
+
+    auto settings = std::make_shared<Settings>();
+    if (!settings->readSettings(filename))
+        return nullptr;
+    return settings;
+}
+
+void KernelsBenchmark::calculatePosition_data()
+{
+    QTest::addColumn<int>("notes");
+    for (int notes : { 100, 1000, 10000, 100000 })
+        QTest::newRow(qPrintable(QString("%1 notes").arg(notes))) << notes;
+}
+
+void KernelsBenchmark::calculatePosition()
+{
+    QFETCH(int, notes);
+    LoadedScore loaded;
+    auto score = QSharedPointer<ScoreModel>::create();
+    for (int i = 0; i < notes; i++)
+        score->addNote(i * 480, 480, 48 + (i * 7) % 36, 64, 0);
+    score->finish();
+    loaded.score = score;
+    loaded.rows->dtw_row.fill(0, notes);
+    loaded.rows->next_row.fill(0, notes);
+
+    ChannelFollower follower(m_settings->channelParts()[0]);
+    follower.setScore(loaded);
+    int note = 0;
+    QBENCHMARK {
+        follower.m_current_note_number = 48 + (note++ * 7) % 36;
+        follower.calculatePosition();
+    }
+}
+
+void KernelsBenchmark::convertBufferToAudio_data()
+{
+    QTest::addColumn<int>("sample_size");
+    QTest::addColumn<int>("sample_type");
+    QTest::addColumn<int>("byte_order");
+    QTest::newRow("8 bit signed") << 8 << int(QAudioFormat::SignedInt) << int(QAudioFormat::LittleEndian);
+    QTest::newRow("16 bit signed little endian") << 16 << int(QAudioFormat::SignedInt) << int(QAudioFormat::LittleEndian);
+    QTest::newRow("16 bit signed big endian") << 16 << int(QAudioFormat::SignedInt) << int(QAudioFormat::BigEndian);
+    QTest::newRow("32 bit signed little endian") << 32 << int(QAudioFormat::SignedInt) << int(QAudioFormat::LittleEndian);
+    QTest::newRow("32 bit float") << 32 << int(QAudioFormat::Float) << int(QAudioFormat::LittleEndian);
+}
+
+void KernelsBenchmark::convertBufferToAudio()
+{
+    QFETCH(int, sample_size);
+    QFETCH(int, sample_type);
+    QFETCH(int, byte_order);
+    QAudioFormat format;
+    format.setChannelCount(1);
+    format.setSampleRate(m_settings->sampleRate());
+    format.setSampleSize(sample_size);
+    format.setSampleType(QAudioFormat::SampleType(sample_type));
+    format.setByteOrder(QAudioFormat::Endian(byte_order));
+    format.setCodec("audio/pcm");
+
+    const int samples = 4096;
+    QByteArray data(samples * sample_size / 8, '\0');
+    for (int i = 0; i < data.size(); i++)
+        data[i] = static_cast<char>(i * 31);
+    const QAudioBuffer buffer(data, format);
+
+    SettingsSource settings_source;
+    settings_source.publish(m_settings);
+    Recorder recorder;
+    recorder.setSettingsSource(&settings_source);
+    recorder.updateSettings();
+    QBENCHMARK {
+        for (auto follower : recorder.m_channels) {
+            follower->m_audio_frame.clear();
+            follower->m_memory.clear();
+        }
+        recorder.convertBufferToAudio(buffer);
+    }
+}
+
+void KernelsBenchmark::quantizePitch_data()
+{
+    QTest::addColumn<float>("pitch_step"); // ratio between consecutive pitches
+    QTest::newRow("steady pitch") << 1.f;
+    QTest::newRow("changing pitch") << 1.0595f;
+}
+
+void KernelsBenchmark::quantizePitch()
+{
+    QFETCH(float, pitch_step);
+    const PitchQuantizer quantizer(m_settings->referencePitch(), m_settings->pitchHysteresis());
+    QVector<float> pitches(4096);
+    float pitch = 27.5f;
+    for (auto &value : pitches) {
+        value = pitch;
+        pitch = pitch * pitch_step > 4200 ? 27.5f : pitch * pitch_step;
+    }
+
+    int note = 0;
+    QBENCHMARK {
+        for (float value : pitches)
+            note = quantizer.quantize(value, note);
+    }
+    QVERIFY(note >= 0);
+}
+
+void KernelsBenchmark::frameChain_data()
+{
+    QTest::addColumn<int>("frame_size");
+    for (int frame_size : { 1024, 2048, 4096, 9600 })
+        QTest::newRow(qPrintable(QString("%1 samples").arg(frame_size))) << frame_size;
+}
+
+void KernelsBenchmark::frameChain()
+{
+    QFETCH(int, frame_size);
+    SettingsPointer settings = readSettings(frame_size);
+    QVERIFY(settings != nullptr);
+
+    ChannelFollower follower(settings->channelParts()[0]);
+    follower.setSettings(settings.get());
+    follower.m_audio_frame.resize(frame_size);
+    for (int i = 0; i < frame_size; i++)
+        follower.m_audio_frame[i] = std::sin(2 * 3.14159265f * 440 * i / settings->sampleRate());
+    QBENCHMARK {
+        follower.m_window_calculator->compute();
+        follower.m_spectrum_calculator->compute();
+        follower.m_pitch_detector->compute();
+    }
+    QVERIFY(qAbs(follower.m_current_pitch - 440) < 5);
+}
+
+QImage KernelsBenchmark::drawPage() const
+{
+    // a6 landscape page at 160 dpi with staffs as lilypond draws them
+    QImage page(932, 661, QImage::Format_RGB32);
+    page.fill(Qt::white);
+    QPainter painter(&page);
+    painter.setPen(Qt::black);
+    const int staff_spacing = 120;
+    for (int staff = 0; staff < m_settings->staffsPerPage(); staff++) {
+        for (int line = 0; line < 5; line++) {
+            const int y = 60 + staff * staff_spacing + line * 10;
+            painter.drawLine(m_settings->staffIndent() - 10, y, page.width() - 40, y);
+        }
+    }
+    return page;
+}
+
+void KernelsBenchmark::calculateIndicatorYs_data()
+{
+    QTest::addColumn<int>("pages");
+    for (int pages : { 1, 10, 50 })
+        QTest::newRow(qPrintable(QString("%1 pages").arg(pages))) << pages;
+}
+
+void KernelsBenchmark::calculateIndicatorYs()
+{
+    QFETCH(int, pages);
+    Lilypond lilypond;
+    lilypond.m_settings = m_settings;
+    const QVector<QImage> images(pages, drawPage());
+    QBENCHMARK {
+        for (auto &image : images)
+            QCOMPARE(lilypond.calculateIndicatorYs(image).size(), m_settings->staffsPerPage());
+    }
+}
+
+QTEST_MAIN(KernelsBenchmark)
+
+#include "kernelsbenchmark.moc"
@@ -0,0 +1,25 @@
+# Author: Jakub Precht
+
+# Compares streaming MusicXML import against reading the same file into a DOM first.
+# Run with e.g. "./musicxml-benchmark -csv" or "-o results.xml,xml" for machine readable output.
+
+TARGET = musicxml-benchmark
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -O2 -Wall -Wshadow -Wpedantic -Wextra
+
+QT += core xml testlib
+QT -= gui
+
+INCLUDEPATH += ../../include
+
+HEADERS += \
+    ../../include/musicxmlreader.h \
+    ../../include/scoremodel.h
+
+SOURCES += \
+    musicxmlbenchmark.cpp \
+    ../../src/musicxmlreader.cpp \
+    ../../src/scoremodel.cpp
+
+LIBS += -lz
@@ -0,0 +1,480 @@
+// Author:  Jakub Precht
+
+#include "musicxmlreader.h"
+
+#include <QtTest>
+#include <QBuffer>
+#include <QDomDocument>
+#include <QProcess>
+#include <QTemporaryDir>
+#include <QXmlStreamWriter>
+#include <QtEndian>
+
+#include <zlib.h>
+
+// Synthetic partwise scores of growing size, read by MusicXmlReader and by a DOM based reader doing the
+// same conversion. Scores have the usual mix of chords, a second voice after backup, ties and notation
+// elements which are skipped. Every score is also written compressed (.mxl), which only the streaming
+// reader reads. Besides time, peak memory of reading is measured, each in its own process as the high
+// water mark of resident memory only grows.
+class MusicXmlBenchmark : public QObject
+{
+    Q_OBJECT
+
+public:
+    static int printPeakMemory(const QString &reader, const QString &filename); // child process mode
+
+private slots:
+    void initTestCase();
+    void sameAsDom_data();
+    void sameAsDom();
+    void streaming_data();
+    void streaming();
+    void dom_data();
+    void dom();
+    void peakMemory_data();
+    void peakMemory();
+
+private:
+    struct ScoreFiles
+    {
+        QString xml;
+        QString mxl;
+        int notes; // after ties are joined
+    };
+
+    void addData(bool compressed);
+    QString writeScore(int notes);
+    bool writeCompressedScore(const QString &xml_filename, const QString &filename);
+    static ScorePointer readDom(QIODevice *device);
+    static ScorePointer read(const QString &reader, const QString &filename);
+    static qint64 memoryStatus(const QByteArray &field); // in bytes, from /proc/self/status
+
+    QTemporaryDir m_directory;
+    QMap<int, ScoreFiles> m_files; // by notes written
+
+    static const int m_parts = 4;
+    static const int m_notes_per_measure = 7;
+    static const qint64 m_large_file = 10 * 1024 * 1024; // bytes, from which streaming must stay below size
+};
+
+void MusicXmlBenchmark::initTestCase()
+{
+    QVERIFY(m_directory.isValid());
+    for (int notes : { 1000, 10000, 100000, 1000000 }) {
+        ScoreFiles files;
+        files.xml = writeScore(notes);
+        files.mxl = m_directory.filePath(QString("score-%1.mxl").arg(notes));
+        QVERIFY(writeCompressedScore(files.xml, files.mxl));
+        // half note tied over every bar line is one note
+        const int measures = qMax(1, notes / (m_parts * m_notes_per_measure));
+        files.notes = m_parts * (measures * m_notes_per_measure - (measures - 1));
+        m_files.insert(notes, files);
+    }
+}
+
+void MusicXmlBenchmark::addData(bool compressed)
+{
+    QTest::addColumn<QString>("filename");
+    QTest::addColumn<QString>("xml_filename");
+    QTest::addColumn<int>("notes");
+    for (auto it = m_files.cbegin(); it != m_files.cend(); ++it) {
+        QTest::newRow(qPrintable(QString("%1 notes").arg(it.key()))) << it->xml << it->xml << it->notes;
+        if (compressed)
+            QTest::newRow(qPrintable(QString("%1 notes mxl").arg(it.key()))) << it->mxl << it->xml << it->notes;
+    }
+}
+
+void MusicXmlBenchmark::sameAsDom_data()
+{
+    addData(true);
+}
+
+void MusicXmlBenchmark::sameAsDom()
+{
+    QFETCH(QString, filename);
+    QFETCH(QString, xml_filename);
+    QFETCH(int, notes);
+    const ScorePointer streamed = read("streaming", filename);
+    const ScorePointer expected = read("dom", xml_filename);
+    QCOMPARE(expected->size(), notes);
+    QCOMPARE(streamed->size(), expected->size());
+    for (int i = 0; i < expected->size(); i++) {
+        QCOMPARE(streamed->pitches()[i], expected->pitches()[i]);
+        QCOMPARE(streamed->onsets()[i], expected->onsets()[i]);
+    }
+}
+
+void MusicXmlBenchmark::streaming_data()
+{
+    addData(true);
+}
+
+void MusicXmlBenchmark::streaming()
+{
+    QFETCH(QString, filename);
+    QFETCH(int, notes);
+    QBENCHMARK {
+        ScorePointer score = MusicXmlReader::readFile(filename);
+        QCOMPARE(score->size(), notes);
+    }
+}
+
+void MusicXmlBenchmark::dom_data()
+{
+    addData(false);
+}
+
+void MusicXmlBenchmark::dom()
+{
+    QFETCH(QString, filename);
+    QFETCH(int, notes);
+    QBENCHMARK {
+        QFile file(filename);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        ScorePointer score = readDom(&file);
+        QCOMPARE(score->size(), notes);
+    }
+}
+
+void MusicXmlBenchmark::peakMemory_data()
+{
+    QTest::addColumn<QString>("reader");
+    QTest::addColumn<QString>("filename");
+    QTest::addColumn<QString>("xml_filename");
+    for (auto it = m_files.cbegin(); it != m_files.cend(); ++it) {
+        QTest::newRow(qPrintable(QString("streaming %1 notes").arg(it.key()))) << "streaming" << it->xml << it->xml;
+        QTest::newRow(qPrintable(QString("streaming %1 notes mxl").arg(it.key()))) << "streaming" << it->mxl << it->xml;
+        QTest::newRow(qPrintable(QString("dom %1 notes").arg(it.key()))) << "dom" << it->xml << it->xml;
+    }
+}
+
+void MusicXmlBenchmark::peakMemory()
+{
+    QFETCH(QString, reader);
+    QFETCH(QString, filename);
+    QFETCH(QString, xml_filename);
+
+    QProcess process;
+    process.start(QCoreApplication::applicationFilePath(), { "--peak-memory", reader, filename });
+    QVERIFY(process.waitForFinished(-1));
+    QCOMPARE(process.exitCode(), 0);
+    bool ok = false;
+    const qint64 peak = process.readAllStandardOutput().trimmed().toLongLong(&ok);
+    QVERIFY(ok);
+    QTest::setBenchmarkResult(peak, QTest::BytesAllocated);
+
+    // streaming keeps notes, not the document, so for large files it needs less than the file itself
+    const qint64 xml_size = QFileInfo(xml_filename).size();
+    if (reader == "streaming" && xml_size >= m_large_file) {
+        QVERIFY2(peak < xml_size, qPrintable(QString("peak %1 MiB for %2 MiB of MusicXML")
+                                             .arg(peak >> 20).arg(xml_size >> 20)));
+    }
+}
+
+int MusicXmlBenchmark::printPeakMemory(const QString &reader, const QString &filename)
+{
+    const qint64 before = memoryStatus("VmRSS:");
+    const ScorePointer score = read(reader, filename); // kept until peak is read
+    const qint64 peak = memoryStatus("VmHWM:");
+    if (before < 0 || peak < 0 || score->isEmpty())
+        return 1;
+    QTextStream(stdout) << qMax<qint64>(0, peak - before) << '\n';
+    return 0;
+}
+
+ScorePointer MusicXmlBenchmark::read(const QString &reader, const QString &filename)
+{
+    if (reader == "streaming")
+        return MusicXmlReader::readFile(filename);
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return ScorePointer::create();
+    return readDom(&file);
+}
+
+qint64 MusicXmlBenchmark::memoryStatus(const QByteArray &field)
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly | QIODevice::Text))
+        return -1;
+    for (QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()) {
+        if (line.startsWith(field))
+            return line.mid(field.size()).simplified().split(' ').value(0).toLongLong() * 1024; // in kB
+    }
+    return -1;
+}
+
+QString MusicXmlBenchmark::writeScore(int notes)
+{
+    static const char *steps[] = { "C", "D", "E", "F", "G", "A", "B" };
+    const QString filename = m_directory.filePath(QString("score-%1.musicxml").arg(notes));
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+        return filename;
+
+    QXmlStreamWriter xml(&file);
+    xml.setAutoFormatting(true);
+    xml.writeStartDocument();
+    xml.writeStartElement("score-partwise");
+    xml.writeAttribute("version", "3.1");
+    xml.writeStartElement("part-list");
+    for (int part = 0; part < m_parts; part++) {
+        xml.writeStartElement("score-part");
+        xml.writeAttribute("id", QString("P%1").arg(part + 1));
+        xml.writeTextElement("part-name", QString("Part %1").arg(part + 1));
+        xml.writeEndElement();
+    }
+    xml.writeEndElement();
+
+    auto write_note = [&](int pitch, int duration, bool chord, const QString &type, const QString &tie) {
+        xml.writeStartElement("note");
+        if (chord)
+            xml.writeEmptyElement("chord");
+        xml.writeStartElement("pitch");
+        xml.writeTextElement("step", steps[pitch % 7]);
+        xml.writeTextElement("octave", QString::number(3 + pitch / 7 % 3));
+        xml.writeEndElement();
+        xml.writeTextElement("duration", QString::number(duration));
+        if (!tie.isEmpty()) {
+            xml.writeEmptyElement("tie");
+            xml.writeAttribute("type", tie);
+        }
+        xml.writeTextElement("voice", "1");
+        xml.writeTextElement("type", type);
+        xml.writeTextElement("stem", "up");
+        xml.writeStartElement("notations");
+        xml.writeEmptyElement("articulations");
+        xml.writeEndElement();
+        xml.writeEndElement();
+    };
+
+    const int measures = qMax(1, notes / (m_parts * m_notes_per_measure));
+    for (int part = 0; part < m_parts; part++) {
+        xml.writeStartElement("part");
+        xml.writeAttribute("id", QString("P%1").arg(part + 1));
+        for (int measure = 0; measure < measures; measure++) {
+            xml.writeStartElement("measure");
+            xml.writeAttribute("number", QString::number(measure + 1));
+            if (measure == 0) {
+                xml.writeStartElement("attributes");
+                xml.writeTextElement("divisions", "4");
+                xml.writeEndElement();
+                xml.writeStartElement("direction");
+                xml.writeEmptyElement("sound");
+                xml.writeAttribute("tempo", "96");
+                xml.writeEndElement();
+            }
+            // four quarters with a chord, then two halves in second voice, last one tied over the bar
+            for (int i = 0; i < 4; i++)
+                write_note(measure + i, 4, false, "quarter", "");
+            write_note(measure + 2, 4, true, "quarter", "");
+            xml.writeStartElement("backup");
+            xml.writeTextElement("duration", "16");
+            xml.writeEndElement();
+            write_note(measure + 5, 8, false, "half", measure > 0 ? "stop" : "");
+            write_note(measure + 6, 8, false, "half", "start");
+            xml.writeEndElement();
+        }
+        xml.writeEndElement();
+    }
+    xml.writeEndElement();
+    xml.writeEndDocument();
+    return filename;
+}
+
+bool MusicXmlBenchmark::writeCompressedScore(const QString &xml_filename, const QString &filename)
+{
+    QFile input(xml_filename);
+    QFile zip(filename);
+    if (!input.open(QIODevice::ReadOnly) || !zip.open(QIODevice::WriteOnly))
+        return false;
+
+    auto le16 = [](QByteArray &data, quint16 value) {
+        const quint16 little = qToLittleEndian(value);
+        data.append(reinterpret_cast<const char *>(&little), sizeof(little));
+    };
+    auto le32 = [](QByteArray &data, quint32 value) {
+        const quint32 little = qToLittleEndian(value);
+        data.append(reinterpret_cast<const char *>(&little), sizeof(little));
+    };
+    QByteArray directory;
+    int entries = 0;
+
+    // local header is written with sizes and crc unknown and patched once the entry is compressed
+    auto write_entry = [&](const QByteArray &name, QIODevice *content) -> bool {
+        const qint64 header_offset = zip.pos();
+        QByteArray header;
+        le32(header, 0x04034b50);
+        le16(header, 20); // version needed
+        le16(header, 0); // flags
+        le16(header, 8); // deflated
+        le16(header, 0); // time
+        le16(header, 0); // date
+        le32(header, 0); // crc, patched
+        le32(header, 0); // compressed size, patched
+        le32(header, 0); // size, patched
+        le16(header, static_cast<quint16>(name.size()));
+        le16(header, 0); // extra field
+        zip.write(header + name);
+
+        z_stream stream;
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+        uLong crc = crc32(0, Z_NULL, 0);
+        quint32 size = 0;
+        quint32 compressed_size = 0;
+        QByteArray output(64 * 1024, '\0');
+        int flush = Z_NO_FLUSH;
+        while (flush != Z_FINISH) {
+            QByteArray chunk = content->read(64 * 1024);
+            flush = content->atEnd() ? Z_FINISH : Z_NO_FLUSH;
+            crc = crc32(crc, reinterpret_cast<const Bytef *>(chunk.constData()), static_cast<uInt>(chunk.size()));
+            size += static_cast<quint32>(chunk.size());
+            stream.next_in = reinterpret_cast<Bytef *>(chunk.data());
+            stream.avail_in = static_cast<uInt>(chunk.size());
+            do {
+                stream.next_out = reinterpret_cast<Bytef *>(output.data());
+                stream.avail_out = static_cast<uInt>(output.size());
+                deflate(&stream, flush);
+                const int produced = output.size() - static_cast<int>(stream.avail_out);
+                zip.write(output.constData(), produced);
+                compressed_size += static_cast<quint32>(produced);
+            } while (stream.avail_out == 0);
+        }
+        deflateEnd(&stream);
+
+        const qint64 end = zip.pos();
+        QByteArray sizes;
+        le32(sizes, static_cast<quint32>(crc));
+        le32(sizes, compressed_size);
+        le32(sizes, size);
+        zip.seek(header_offset + 14);
+        zip.write(sizes);
+        zip.seek(end);
+
+        le32(directory, 0x02014b50);
+        le16(directory, 20); // version made by
+        directory += header.mid(4, 6); // version needed, flags, method
+        le16(directory, 0); // time
+        le16(directory, 0); // date
+        directory += sizes;
+        le16(directory, static_cast<quint16>(name.size()));
+        le16(directory, 0); // extra field
+        le16(directory, 0); // comment
+        le16(directory, 0); // disk
+        le16(directory, 0); // internal attributes
+        le32(directory, 0); // external attributes
+        le32(directory, static_cast<quint32>(header_offset));
+        directory += name;
+        entries++;
+        return true;
+    };
+
+    QBuffer container;
+    container.setData("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<container><rootfiles>"
+                      "<rootfile full-path=\"score.musicxml\"/></rootfiles></container>\n");
+    container.open(QIODevice::ReadOnly);
+    if (!write_entry("META-INF/container.xml", &container) || !write_entry("score.musicxml", &input))
+        return false;
+
+    const qint64 directory_offset = zip.pos();
+    QByteArray end;
+    le32(end, 0x06054b50);
+    le16(end, 0); // disk
+    le16(end, 0); // disk of directory
+    le16(end, static_cast<quint16>(entries));
+    le16(end, static_cast<quint16>(entries));
+    le32(end, static_cast<quint32>(directory.size()));
+    le32(end, static_cast<quint32>(directory_offset));
+    le16(end, 0); // comment
+    zip.write(directory + end);
+    return zip.error() == QFileDevice::NoError;
+}
+
+ScorePointer MusicXmlBenchmark::readDom(QIODevice *device)
+{
+    QDomDocument document;
+    if (!document.setContent(device))
+        return ScorePointer::create();
+
+    static const int step_semitones[] = { 9, 11, 0, 2, 4, 5, 7 };
+    QSharedPointer<ScoreModel> score = QSharedPointer<ScoreModel>::create();
+    const int quarter = score->ticksPerQuarter();
+    const QDomNodeList parts = document.documentElement().elementsByTagName("part");
+    for (int voice = 0; voice < parts.size(); voice++) {
+        double divisions = 1;
+        qint64 position = 0;
+        qint64 chord_onset = 0;
+        QHash<int, QPair<qint64, qint64>> tied_notes; // onset and duration by pitch
+        for (QDomElement measure = parts.at(voice).firstChildElement("measure"); !measure.isNull();
+             measure = measure.nextSiblingElement("measure")) {
+            qint64 measure_end = position;
+            for (QDomElement element = measure.firstChildElement(); !element.isNull();
+                 element = element.nextSiblingElement()) {
+                const qint64 duration = qRound64(element.firstChildElement("duration").text().toDouble()
+                                                 * quarter / divisions);
+                if (element.tagName() == "attributes") {
+                    const QDomElement divisions_element = element.firstChildElement("divisions");
+                    if (!divisions_element.isNull())
+                        divisions = divisions_element.text().toDouble();
+                } else if (element.tagName() == "direction") {
+                    const double tempo = element.firstChildElement("sound").attribute("tempo").toDouble();
+                    if (tempo > 0)
+                        score->addTempoChange(position, static_cast<qint32>(qRound(60e6 / tempo)));
+                } else if (element.tagName() == "backup") {
+                    position = qMax<qint64>(position - duration, 0);
+                } else if (element.tagName() == "forward") {
+                    position += duration;
+                    measure_end = qMax(measure_end, position);
+                } else if (element.tagName() == "note") {
+                    if (!element.firstChildElement("grace").isNull())
+                        continue;
+                    if (element.firstChildElement("chord").isNull()) {
+                        chord_onset = position;
+                        position += duration;
+                        measure_end = qMax(measure_end, position);
+                    }
+                    const QDomElement pitch_element = element.firstChildElement("pitch");
+                    if (pitch_element.isNull())
+                        continue;
+                    const int step = pitch_element.firstChildElement("step").text().at(0).unicode() - 'A';
+                    const int pitch = (pitch_element.firstChildElement("octave").text().toInt() + 1) * 12
+                            + step_semitones[step] + qRound(pitch_element.firstChildElement("alter").text().toDouble());
+
+                    const QString tie = element.firstChildElement("tie").attribute("type");
+                    QPair<qint64, qint64> note(chord_onset, duration);
+                    if (tie == "stop" && tied_notes.contains(pitch)) {
+                        note.second = chord_onset + duration - tied_notes[pitch].first;
+                        note.first = tied_notes.take(pitch).first;
+                    }
+                    if (tie == "start")
+                        tied_notes.insert(pitch, note);
+                    else
+                        score->addNote(note.first, static_cast<qint32>(note.second), pitch, 64, voice);
+                }
+            }
+            position = measure_end;
+        }
+        for (auto it = tied_notes.begin(); it != tied_notes.end(); ++it)
+            score->addNote(it->first, static_cast<qint32>(it->second), it.key(), 64, voice);
+    }
+    score->finish();
+    return score;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 4 && qstrcmp(argv[1], "--peak-memory") == 0)
+        return MusicXmlBenchmark::printPeakMemory(argv[2], argv[3]);
+
+    QCoreApplication app(argc, argv);
+    MusicXmlBenchmark benchmark;
+    QTEST_SET_MAIN_SOURCE_PATH
+    return QTest::qExec(&benchmark, argc, argv);
+}
+
+#include "musicxmlbenchmark.moc"
@@ -0,0 +1,20 @@
+# Author: Jakub Precht
+
+# Stand-in OSC and WebSocket clients checking what PositionOutput publishes, run with "make check".
+
+TARGET = output-test
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -O2 -Wall -Wshadow -Wpedantic -Wextra
+
+QT += core network websockets testlib
+QT -= gui
+
+INCLUDEPATH += ../../include
+
+HEADERS += \
+    ../../include/positionoutput.h
+
+SOURCES += \
+    outputtest.cpp \
+    ../../src/positionoutput.cpp
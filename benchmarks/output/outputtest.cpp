@@ -0,0 +1,134 @@
+// Author:  Jakub Precht
+
+#include "positionoutput.h"
+
+#include <QtTest>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpServer>
+#include <QUdpSocket>
+#include <QWebSocket>
+
+#include <cstring>
+
+// PositionOutput seen from the outside: a UDP socket stands in for an OSC consumer (lighting, displays)
+// and a QWebSocket for a page turner page.
+class OutputTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void oscBundle();
+    void webSocketCoalesces();
+
+private:
+    static int freePort();
+    static QHash<QByteArray, QVariant> readOscBundle(const QByteArray &bundle);
+    static QByteArray readOscString(const QByteArray &data, int &offset);
+    static quint32 readBigEndian(const QByteArray &data, int &offset);
+
+    const int m_interval = 50; // ms
+};
+
+void OutputTest::oscBundle()
+{
+    QUdpSocket consumer;
+    QVERIFY(consumer.bind(QHostAddress::LocalHost, 0));
+    PositionOutput output;
+    QVERIFY(output.configure({ QString("127.0.0.1:%1").arg(consumer.localPort()) }, 0, m_interval));
+
+    output.publish(12, 2, 3.5f);
+    QTRY_VERIFY(consumer.hasPendingDatagrams());
+    QByteArray datagram(static_cast<int>(consumer.pendingDatagramSize()), '\0');
+    consumer.readDatagram(datagram.data(), datagram.size());
+
+    const QHash<QByteArray, QVariant> values = readOscBundle(datagram);
+    QCOMPARE(values.value("/scorefollower/position").toInt(), 12);
+    QCOMPARE(values.value("/scorefollower/page").toInt(), 2);
+    QCOMPARE(values.value("/scorefollower/tempo").toFloat(), 3.5f);
+}
+
+void OutputTest::webSocketCoalesces()
+{
+    const int port = freePort();
+    PositionOutput output;
+    QVERIFY(output.configure({ }, port, m_interval));
+    output.publish(7, 1, 0);
+
+    // client connecting later gets current state first
+    QWebSocket client;
+    QVector<QJsonObject> messages;
+    connect(&client, &QWebSocket::textMessageReceived, this, [&](const QString &message){
+        messages.push_back(QJsonDocument::fromJson(message.toUtf8()).object());
+    });
+    client.open(QUrl(QString("ws://127.0.0.1:%1/").arg(port)));
+    QTRY_COMPARE(messages.size(), 1);
+    QCOMPARE(messages[0].value("position").toInt(), 7);
+
+    // position moving every millisecond reaches the client at most once per interval, ending at latest
+    const int updates = 300;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 1; i <= updates; i++) {
+        output.publish(i, 1 + i / 100, i / 10.f);
+        QTest::qWait(1);
+    }
+    QTRY_COMPARE(messages.last().value("position").toInt(), updates);
+    QCOMPARE(messages.last().value("page").toInt(), 4);
+    const int expected = static_cast<int>(timer.elapsed() / m_interval) + 2;
+    QVERIFY2(messages.size() - 1 <= expected, qPrintable(QString("%1 messages for %2 updates, expected at most %3")
+                                                         .arg(messages.size() - 1).arg(updates).arg(expected)));
+}
+
+int OutputTest::freePort()
+{
+    QTcpServer server;
+    server.listen(QHostAddress::LocalHost, 0);
+    return server.serverPort();
+}
+
+QHash<QByteArray, QVariant> OutputTest::readOscBundle(const QByteArray &bundle)
+{
+    QHash<QByteArray, QVariant> values;
+    int offset = 0;
+    if (readOscString(bundle, offset) != "#bundle")
+        return values;
+    offset += 8; // time tag
+
+    while (offset + 4 <= bundle.size()) {
+        const quint32 size = readBigEndian(bundle, offset);
+        const int end = offset + static_cast<int>(size);
+        const QByteArray address = readOscString(bundle, offset);
+        const QByteArray types = readOscString(bundle, offset);
+        const quint32 value = readBigEndian(bundle, offset);
+        if (types == ",i") {
+            values.insert(address, static_cast<qint32>(value));
+        } else if (types == ",f") {
+            float number = 0;
+            std::memcpy(&number, &value, sizeof(number));
+            values.insert(address, number);
+        }
+        offset = end;
+    }
+    return values;
+}
+
+QByteArray OutputTest::readOscString(const QByteArray &data, int &offset)
+{
+    const QByteArray string = data.mid(offset, data.indexOf('\0', offset) - offset);
+    offset += (string.size() / 4 + 1) * 4;
+    return string;
+}
+
+quint32 OutputTest::readBigEndian(const QByteArray &data, int &offset)
+{
+    quint32 value = 0;
+    for (int i = 0; i < 4; i++)
+        value = (value << 8) | static_cast<quint8>(data.at(offset + i));
+    offset += 4;
+    return value;
+}
+
+QTEST_GUILESS_MAIN(OutputTest)
+
+#include "outputtest.moc"
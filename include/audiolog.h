@@ -0,0 +1,57 @@
+// Author:  Jakub Precht
+
+#ifndef AUDIOLOG_H
+#define AUDIOLOG_H
+
+#include <QtGlobal>
+
+#include <atomic>
+
+class QThread;
+
+// Log of the audio path. Calls only put a fixed size record into a lock-free ring (any number of writer
+// threads, one reader), without formatting, allocating or waiting; a background thread formats records
+// and passes them to Qt logging. When the ring is full records are dropped and counted, and the count
+// is reported once there is room again. Records written before start are printed when it is called.
+class AudioLog
+{
+public:
+    enum Message
+    {
+        NoteDetected, // note, cents
+        NoteSkipped, // note, times, minimal confidence
+        SamplesPerSecond, // samples
+        BufferSize, // samples
+        UnsupportedFormat,
+        ResamplingFailed, // libsamplerate error
+        InputRate // samples per second of audio input, analysis rate
+    };
+
+    static void write(Message message, qint32 first = 0, qint32 second = 0, float value = 0);
+    static void start();
+    static void stop(); // prints what is left in the ring
+
+private:
+    struct Record
+    {
+        qint64 time; // ms since epoch
+        Message message;
+        qint32 first;
+        qint32 second;
+        float value;
+    };
+
+    struct Ring;
+    class Formatter;
+
+    static void format(const Record &record);
+    static void drain();
+
+    static Ring m_ring;
+    static QThread *m_formatter;
+
+    static const quint32 m_capacity = 1024; // records, power of two
+    static const int m_poll_interval = 20; // ms
+};
+
+#endif // AUDIOLOG_H
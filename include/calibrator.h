@@ -0,0 +1,50 @@
+// Author:  Jakub Precht
+
+#ifndef CALIBRATOR_H
+#define CALIBRATOR_H
+
+#include "settings.h"
+#include "pitchquantizer.h"
+
+#include <QString>
+#include <QVector>
+
+// Fills "average detection confidence" column of the notes table from a recording. Recording is
+// either annotated (lines "<start seconds> <end seconds> <midi note>") or a plain scale, where every
+// steady run of one detected note is taken as that note being played. Frames are analysed in
+// parallel with the same essentia chain as Recorder and results are written back to settings file.
+class Calibrator
+{
+public:
+    explicit Calibrator(const SettingsPointer &settings);
+
+    bool calibrate(const QString &recording, const QString &annotations = QString());
+
+private:
+    struct Frame
+    {
+        float pitch = 0;
+        float confidence = 0;
+        int note = -1; // detected
+        int expected_note = -1; // -1 when frame is not used for calibration
+    };
+
+    bool loadAudio(const QString &recording, std::vector<float> &audio) const;
+    QVector<Frame> analyse(const std::vector<float> &audio) const;
+    bool labelFromAnnotations(const QString &annotations, QVector<Frame> &frames) const;
+    void labelFromSteadyNotes(QVector<Frame> &frames) const;
+    QVector<float> averageConfidences(const QVector<Frame> &frames) const; // -1 for notes without data
+    bool writeSettings(const QVector<float> &confidences) const;
+
+    // ----------
+
+    SettingsPointer m_settings;
+    PitchQuantizer m_pitch_quantizer;
+
+    const int m_notes_count = 128;
+    const int m_minimal_frames = 10; // for a note to be calibrated
+    const int m_minimal_run = 5; // frames of steady note in not annotated recording
+    const float m_minimal_run_confidence = 0.2f;
+};
+
+#endif // CALIBRATOR_H
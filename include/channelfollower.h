@@ -0,0 +1,117 @@
+// Author:  Jakub Precht
+
+#ifndef CHANNELFOLLOWER_H
+#define CHANNELFOLLOWER_H
+
+#include "pitchquantizer.h"
+#include "resampler.h"
+#include "scoreloader.h"
+#include "settings.h"
+
+#include <essentia/algorithmfactory.h>
+
+#include <QVector>
+
+#include <deque>
+#include <vector>
+
+// Follows one part of the score in one input channel or a mix of channels: collects samples into frames,
+// detects pitch of every frame and aligns detected notes with notes of the part by dtw. Recorder passes
+// every sample to its channel followers in one pass over the buffer; after that they share nothing, so
+// followers of different channels process their frames in parallel.
+class ChannelFollower
+{
+public:
+    explicit ChannelFollower(const ChannelPart &channel_part);
+    ~ChannelFollower();
+
+    void setSettings(const Settings *settings); // kept alive by owner of follower
+    void setInputRate(int input_rate); // of added samples, they are resampled to analysis rate
+    void resetInput(); // after a gap in audio, so samples on its two sides are not interpolated together
+    void setScore(const LoadedScore &score); // takes rows prepared by loader when they fit the part
+    void reset();
+
+    const ChannelPart &channelPart() const;
+    float mixScale() const; // of the sum of mixed channels
+    int playedNotes() const; // of whole score, up to the last note aligned in this part
+
+    inline void addSample(float value);
+    void follow(qint64 buffer_time); // processes every complete frame of added samples
+
+private:
+    Q_DISABLE_COPY(ChannelFollower)
+    friend class KernelsBenchmark; // measures private kernels in isolation
+
+    void initializePitchDetector();
+    void deletePitchDetector();
+    inline void addAnalysisSample(float value);
+    void resampleInput();
+    void processFrame();
+    void calculatePosition();
+
+    // ----------
+
+    ChannelPart m_channel_part;
+    float m_mix_scale = 1;
+    const Settings *m_settings = nullptr;
+    size_t m_frame_size = 0;
+    qint64 m_buffer_time = 0; // arrival of buffer being processed, see Latency
+
+    // resampling, when input rate differs from analysis rate
+
+    int m_input_rate = 0; // 0 until known, then samples are taken as they are
+    Resampler m_resampler;
+    std::vector<float> m_input; // samples at input rate waiting for resampler
+    size_t m_input_size = 0;
+
+    // position
+
+    ScorePointer m_score; // keeps pitches alive
+    QVector<quint8> m_part_pitches; // notes of the part, empty when whole score is followed
+    QVector<int> m_part_notes; // index in score of every note of the part
+    const quint8 *m_pitches = nullptr; // of notes followed
+    QVector<int64_t> m_dtw_row;
+    QVector<int64_t> m_next_row;
+    int m_position = -1; // in followed notes
+
+    // essentia
+
+    int m_current_note_number = 0;
+    float m_current_pitch = 0;
+    float m_current_confidence = 0;
+    float m_current_cents = 0; // deviation of pitch from detected note
+    PitchQuantizer m_pitch_quantizer;
+    bool m_last_was_skipped = false;
+    int m_last_skipped_note = 0;
+    int m_skipped_count = 0;
+
+    std::deque<float> m_memory;
+    std::vector<float> m_audio_frame;
+    std::vector<float> m_spectrum;
+    std::vector<float> m_windowed_frame;
+
+    essentia::standard::Algorithm* m_window_calculator = nullptr;
+    essentia::standard::Algorithm* m_spectrum_calculator = nullptr;
+    essentia::standard::Algorithm* m_pitch_detector = nullptr;
+};
+
+void ChannelFollower::addSample(float value)
+{
+    if (!m_resampler.isActive()) {
+        addAnalysisSample(value);
+        return;
+    }
+    m_input[m_input_size++] = value;
+    if (m_input_size == m_input.size())
+        resampleInput();
+}
+
+void ChannelFollower::addAnalysisSample(float value)
+{
+    if (m_audio_frame.size() < m_frame_size)
+        m_audio_frame.push_back(value);
+    else
+        m_memory.push_back(value);
+}
+
+#endif // CHANNELFOLLOWER_H
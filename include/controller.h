@@ -4,12 +4,23 @@
 #define CONTROLLER_H
 
 #include "lilypond.h"
+#include "metricsserver.h"
+#include "positionoutput.h"
 #include "recorder.h"
+#include "scoreloader.h"
 #include "settings.h"
+#include "scoreimageprovider.h"
+#include "scorelayout.h"
+#include "latestvalue.h"
 
 #include <QObject>
 #include <QTimer>
 #include <QThread>
+#include <QQuickWindow>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+
+#include <atomic>
 
 class Controller : public QObject
 {
@@ -23,17 +34,35 @@ class Controller : public QObject
     Q_PROPERTY(double indicatorScale READ indicatorScale WRITE setIndicatorScale NOTIFY indicatorScaleChanged)
     Q_PROPERTY(int scoreLength READ scoreLength WRITE setScoreLength NOTIFY scoreLengthChanged)
     Q_PROPERTY(int currentPage READ currentPage NOTIFY currentPageChanged)
+    Q_PROPERTY(int previewPage READ previewPage NOTIFY previewPageChanged)
+    Q_PROPERTY(int scoreRevision READ scoreRevision NOTIFY updateScore)
+    Q_PROPERTY(int pageWidth READ pageWidth NOTIFY updateScore)
+    Q_PROPERTY(int pageHeight READ pageHeight NOTIFY updateScore)
+    Q_PROPERTY(bool vectorScore READ vectorScore NOTIFY updateScore)
+    Q_PROPERTY(float loadingProgress READ loadingProgress NOTIFY loadingProgressChanged)
 
 public:
     explicit Controller(bool verbose = false, QObject *parent = nullptr);
     ~Controller();
 
     bool createdSuccessfully() const;
+    void attachWindow(QQuickWindow *window);
 
     int notesPerPage() const;
     int pagesNumber() const;
     int scoreLength() const;
     int currentPage() const;
+    int previewPage() const;
+    int pageFirstNote(int page) const;
+    int pageNotesCount(int page) const;
+    int scoreRevision() const;
+    int pageWidth() const;
+    int pageHeight() const;
+    bool vectorScore() const;
+    float loadingProgress() const;
+    ScoreImageProvider *imageProvider() const;
+
+    Q_INVOKABLE void dumpLatency() const;
 
 public slots:
     int indicatorX(int index);
@@ -56,7 +85,10 @@ signals:
     void updateScore();
     void startRecording();
     void stopRecording();
-    void generateScore();
+    void generateScore(int generation);
+    void loadScore(const QString &filename);
+    void installScore(LoadedScore score);
+    void installScoreModel(ScorePointer score); // for lilypond, which needs no rows
     void levelChanged();
     void followChanged();
     void indicatorWidthChanged();
@@ -67,33 +99,72 @@ signals:
     void pagesNumberChanged();
     void scoreLengthChanged();
     void currentPageChanged();
+    void previewPageChanged();
+    void loadingProgressChanged();
     void cancelledFileOpening();
 
+private slots:
+    void pollRecorder();
+    void finishLoading(LoadedScore score);
+    void reloadSettings();
+
 private:
-    void calculateIndicatorYs();
+    void requestScore();
+    void updateTempo();
     void updateCurrentPage();
+    bool isPageTurnDue(int notes_left) const;
     void resetPageAndPosition();
+    void publishPosition();
 
     // ----------
 
     bool m_status = true;
-    const Settings *m_settings = nullptr;
+    SettingsPointer m_settings; // used by gui
+    SettingsSource m_published_settings; // read by workers
+    QFileSystemWatcher m_settings_watcher;
+    QTimer m_settings_timer; // lets the file be fully written before it is read
+    const int m_settings_reload_delay = 200; // ms
     Lilypond *m_lilypond = nullptr;
     Recorder *m_recorder = nullptr;
+    ScoreLoader *m_loader = nullptr;
+    ScoreImageProvider *m_image_provider = nullptr; // owned by qml engine
+    MetricsServer m_metrics_server;
+    PositionOutput m_position_output;
     QThread m_lilypond_thread;
     QThread m_recorder_thread;
+    QThread m_loader_thread;
 
     int m_played_notes = 0;
     int m_pages_number = 0;
     int m_score_length = 0;
     int m_current_page = 0;
+    int m_played_page = 1; // page of last played note, current one may be turned ahead of it
+    int m_preview_page = 0; // page which top half is shown over current one, 0 if none
+    int m_score_revision = 0;
+    int m_render_generation = 0;
     bool m_follow = 0;
     float m_level = 0;
     double m_indicator_scale = 1;
+    float m_loading_progress = 1;
+
+    QSize m_page_size = QSize(932, 661); // a6 landscape at 160 dpi until first score is rendered
+    QElapsedTimer m_tempo_timer;
+    qint64 m_tempo_last_time = 0;
+    int m_tempo_last_position = 0;
+    float m_notes_per_second = 0; // 0 when unknown
+    const qint64 m_tempo_max_gap = 3000; // ms, longer pause does not tell anything about tempo
+
+    QQuickWindow *m_window = nullptr;
+    LatestValue<int> m_position_input;
+    LatestValue<qint64> m_position_time_input;
+    LatestValue<float> m_level_input;
+    std::atomic<qint64> m_unpainted_position_time { 0 }; // taken by render thread once frame is shown
+    QTimer m_idle_poll_timer;
+    const int m_idle_poll_interval = 50; // ms
 
     QTimer m_timer;
     QString m_file_to_open;
-    QVector<QVector<int>> m_indicator_ys; // for each page generated by lilypond
+    ScoreLayout m_layout;
 };
 
 
@@ -0,0 +1,69 @@
+// Author:  Jakub Precht
+
+#ifndef FOLLOWERSERVER_H
+#define FOLLOWERSERVER_H
+
+#include "latestvalue.h"
+#include "metricsserver.h"
+#include "recorder.h"
+#include "settings.h"
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+
+// Headless follower of many independent sessions (like practice rooms), each with its own score, audio
+// input and follower state. Recorders of sessions are spread over a fixed pool of worker threads, one per
+// core, and share one settings snapshot and scores read once per file. Position, cpu time and processing
+// time of every session are reported periodically.
+class FollowerServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FollowerServer(QObject *parent = nullptr);
+    ~FollowerServer();
+
+    bool start(const QString &sessions_filename);
+
+private slots:
+    void report();
+
+private:
+    struct Session
+    {
+        QString name;
+        QString audio_input; // empty for default one
+        ScorePointer score;
+        Recorder *recorder = nullptr;
+        LatestValue<int> position;
+        LatestValue<qint64> position_time;
+        LatestValue<float> level;
+        int played_notes = 0;
+
+        // totals of recorder statistics at last report
+        quint64 reported_buffers = 0;
+        qint64 reported_cpu_time = 0;
+        qint64 reported_processing_time = 0;
+    };
+
+    bool readSessions(const QString &filename);
+    ScorePointer readScore(const QString &filename);
+
+    // ----------
+
+    SettingsPointer m_settings; // never replaced, sessions only read it
+    SettingsSource m_settings_source; // publishes m_settings to recorders
+    QVector<Session *> m_sessions;
+    QVector<QThread *> m_workers;
+    QHash<QString, ScorePointer> m_scores; // by canonical path
+    MetricsServer m_metrics_server;
+    QTimer m_report_timer;
+    QElapsedTimer m_report_clock;
+    const int m_report_interval = 10000; // ms
+};
+
+#endif // FOLLOWERSERVER_H
@@ -0,0 +1,56 @@
+// Author:  Jakub Precht
+
+#ifndef INDICATORLAYER_H
+#define INDICATORLAYER_H
+
+#include <QQuickItem>
+#include <QVector>
+#include <QPoint>
+
+class Controller;
+
+// Draws indicators of all notes of the displayed page with one geometry node. Vertices are kept in
+// page coordinates under a scaling transform, so resizing does not touch them and moving position
+// only recolors two quads.
+class IndicatorLayer : public QQuickItem
+{
+    Q_OBJECT
+    // QObject, as Controller is not a registered metatype; anything other than Controller is ignored
+    Q_PROPERTY(QObject *scoreController READ scoreController WRITE setScoreController NOTIFY scoreControllerChanged)
+
+public:
+    explicit IndicatorLayer(QQuickItem *parent = nullptr);
+
+    QObject *scoreController() const;
+    void setScoreController(QObject *object);
+
+signals:
+    void scoreControllerChanged();
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *old_node, UpdatePaintNodeData *data) override;
+
+private slots:
+    void updatePage();
+    void updatePosition();
+    void updateScale();
+
+private:
+    void markNoteDirty(int note);
+
+    // ----------
+
+    Controller *m_controller = nullptr;
+
+    int m_first_note = 0; // index of first note of displayed page
+    QVector<QPoint> m_positions; // in page coordinates, for each note of displayed page
+    int m_highlighted_note = -1; // index of note on displayed page
+
+    bool m_page_dirty = true;
+    bool m_scale_dirty = true;
+    QVector<int> m_dirty_notes;
+
+    static const int m_vertices_per_note = 6;
+};
+
+#endif // INDICATORLAYER_H
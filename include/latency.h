@@ -0,0 +1,60 @@
+// Author:  Jakub Precht
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QVector>
+
+#include <chrono>
+#include <ctime>
+
+class QMutex;
+
+// Latency of pipeline stages measured from arrival of the audio buffer which caused them. Every thread
+// counts into its own log scale histograms (four buckets per power of two of microseconds) with
+// plain atomic stores, so recording never locks; report merges them on demand.
+class Latency
+{
+public:
+    enum Stage
+    {
+        FrameCompleted, // pitch of frame computed
+        PitchDecided, // detected note accepted
+        PositionUpdated, // dtw moved and position published
+        PlayedNotesSet, // position taken by gui
+        FrameSwapped, // frame with moved indicator shown
+        StagesCount
+    };
+
+    static qint64 now() // monotonic, in ns
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static qint64 threadCpuTime() // spent by calling thread, in ns
+    {
+        timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return time.tv_sec * 1000000000LL + time.tv_nsec;
+    }
+
+    static void record(Stage stage, qint64 since);
+    static QString report(); // p50, p95 and p99 of every stage, in ms
+
+private:
+    struct ThreadHistograms;
+    static ThreadHistograms &threadHistograms();
+    static int bucket(qint64 nanoseconds);
+    static double bucketUpperBound(int bucket); // in ms
+
+    // histograms of all threads that ever recorded, kept after threads finish so their data is reported
+    static QMutex m_registry_mutex;
+    static QVector<ThreadHistograms *> m_registry;
+
+    static const int m_buckets = 128;
+};
+
+#endif // LATENCY_H
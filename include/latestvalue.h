@@ -0,0 +1,36 @@
+// Author:  Jakub Precht
+
+#ifndef LATESTVALUE_H
+#define LATESTVALUE_H
+
+#include <atomic>
+
+// Single slot passing values between threads. Writer always overwrites previous value and reader takes
+// only the newest one, so neither side ever blocks or waits in a queue. T has to fit std::atomic.
+template <typename T>
+class LatestValue
+{
+public:
+    explicit LatestValue(T value = T()) : m_value(value) { }
+
+    void store(T value)
+    {
+        m_value.store(value, std::memory_order_relaxed);
+        m_fresh.store(true, std::memory_order_release);
+    }
+
+    // returns false if nothing was stored since last call
+    bool take(T &value)
+    {
+        if (!m_fresh.exchange(false, std::memory_order_acquire))
+            return false;
+        value = m_value.load(std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    std::atomic<T> m_value;
+    std::atomic<bool> m_fresh { false };
+};
+
+#endif // LATESTVALUE_H
@@ -3,11 +3,29 @@
 #ifndef LILYPOND_H
 #define LILYPOND_H
 
+#include "scoremodel.h"
+#include "settings.h"
+
 #include <QObject>
 #include <QVector>
 #include <QProcess>
+#include <QImage>
+#include <QTimer>
+#include <QSize>
+
+class LilypondServer;
+
+// Pages of one render, bitmaps in png mode and svg documents in svg mode
+struct RenderedScore
+{
+    int generation = 0;
+    QVector<QImage> pages;
+    QVector<QByteArray> vector_pages;
+    QSize page_size; // at settings dpi, the same as size of bitmap pages
+    QVector<QVector<int>> indicator_ys; // for each page
+};
 
-class Settings;
+Q_DECLARE_METATYPE(RenderedScore)
 
 class Lilypond : public QObject
 {
@@ -15,27 +33,45 @@ class Lilypond : public QObject
 
 public:
     explicit Lilypond(QObject *parent = nullptr);
-    void setScore(const QVector<int> &score_notes);
-    void setSettings(const Settings *settings);
+    void setSettingsSource(const SettingsSource *source);
 
 public slots:
-    void generateScore();
+    void setScore(const ScorePointer &score);
+    void startServers();
+    void requestScore(int generation);
 
 signals:
-    void finishedGeneratingScore(int pages_number, QVector<QVector<int>> indicator_ys);
+    void finishedGeneratingScore(RenderedScore score);
 
 private slots:
-    void finish(int exit_code, QProcess::ExitStatus exit_status);
+    void generateScore();
 
 private:
+    friend class KernelsBenchmark; // measures private kernels in isolation
+
+    void cancelRendering();
+    void finishRendering(bool success, const QString &errors);
+    void startProcess(const QString &directory_path);
+    LilypondServer *readyServer() const;
     int countPages() const;
-    QVector<QVector<int>> calculateIndicatorYs(int pages_number) const;
+    QString pageFileName(int page) const;
+    void loadPages(RenderedScore &score, int pages_number) const;
+    void loadVectorPages(RenderedScore &score, int pages_number) const;
+    QVector<int> calculateIndicatorYs(const QImage &page) const;
 
     // ----------
 
-    QProcess *m_process;
-    const Settings *m_settings;
-    QVector<int> m_score_notes;
+    QProcess *m_process = nullptr;
+    LilypondServer *m_active_server = nullptr;
+    QVector<LilypondServer *> m_servers;
+    QTimer m_requests_timer;
+    int m_requested_generation = 0;
+    int m_rendering_generation = 0; // 0 when nothing is rendered
+    qint64 m_render_begin = 0; // of lilypond subprocess or server, see Trace and Metrics
+    const int m_coalesce_interval = 50; // ms
+    const SettingsSource *m_settings_source = nullptr; // published by gui
+    SettingsPointer m_settings; // snapshot taken when render starts
+    ScorePointer m_score = ScorePointer::create();
 };
 
 
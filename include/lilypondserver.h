@@ -0,0 +1,51 @@
+// Author:  Jakub Precht
+
+#ifndef LILYPONDSERVER_H
+#define LILYPONDSERVER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QString>
+
+// One lilypond instance kept alive in scheme sandbox (guile REPL). Scores are rendered by sending
+// scheme commands through stdin, so guile boot and font loading are paid only once when it starts.
+class LilypondServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LilypondServer(const QString &warmup_file, QObject *parent = nullptr);
+
+    void start();
+    bool isReady() const;
+    void render(const QString &file_name, int dpi, bool vector);
+    void cancel();
+
+signals:
+    void finishedRendering(bool success, QString errors);
+
+private slots:
+    void readOutput();
+    void processFinished(int exit_code, QProcess::ExitStatus exit_status);
+
+private:
+    enum class State { Stopped, Starting, WarmingUp, Ready, Rendering, Cancelling };
+
+    void sendRenderCommand(const QString &file_name, int dpi, bool vector);
+    static QString schemeString(const QString &text);
+
+    // ----------
+
+    QProcess *m_process = nullptr;
+    State m_state = State::Stopped;
+    QString m_warmup_file;
+    QByteArray m_output;
+    int m_failed_starts = 0;
+
+    const int m_max_failed_starts = 3;
+    static const QByteArray m_ready_marker;
+    static const QByteArray m_done_marker;
+    static const QByteArray m_failed_marker;
+};
+
+#endif // LILYPONDSERVER_H
@@ -0,0 +1,54 @@
+// Author:  Jakub Precht
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+#include <atomic>
+
+// Counters and gauges of the running pipeline, exposed in Prometheus text format by MetricsServer.
+// They are plain relaxed atomics, written from the thread doing the work and read only when scraped,
+// so they are always counted, not only in verbose mode. Rates (like detections per second) are left
+// to the scraper, which computes them from counters.
+class Metrics
+{
+public:
+    enum Counter
+    {
+        FramesProcessed, // pitch detected
+        FramesLowConfidence, // note changed, but confidence was below minimal one of the note
+        NotesDetected, // note changes moving dtw
+        BuffersReceived, // by audio probe, before queued to recorder
+        BuffersProcessed,
+        BuffersDropped, // gaps in stream time of received buffers
+        Renders,
+        RenderMicroseconds, // of lilypond subprocess or server, with loading pages
+        CountersCount
+    };
+
+    enum Gauge
+    {
+        DtwCostPerNote, // cost of best alignment divided by number of notes aligned
+        GaugesCount
+    };
+
+    static void add(Counter counter, quint64 value = 1)
+    {
+        m_counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static void set(Gauge gauge, double value)
+    {
+        m_gauges[gauge].store(value, std::memory_order_relaxed);
+    }
+
+    static QByteArray exposition(); // all metrics, in text format version 0.0.4
+
+private:
+    static std::atomic<quint64> m_counters[CountersCount];
+    static std::atomic<double> m_gauges[GaugesCount];
+};
+
+#endif // METRICS_H
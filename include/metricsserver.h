@@ -0,0 +1,35 @@
+// Author:  Jakub Precht
+
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QHash>
+
+class QTcpSocket;
+
+// Minimal HTTP server on localhost answering GET /metrics with Metrics in Prometheus text format.
+// Each connection gets one response and is closed, which is all scrapers and curl need.
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(QObject *parent = nullptr);
+    bool listen(int port); // 0 stops serving
+
+private slots:
+    void acceptConnection();
+
+private:
+    void respond(QTcpSocket *socket);
+
+    // ----------
+
+    QTcpServer m_server;
+    QHash<QTcpSocket *, QByteArray> m_requests; // read so far, until the head is complete
+    const int m_max_request_size = 8192; // bytes, larger requests are cut off
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,73 @@
+// Author:  Jakub Precht
+
+#ifndef MUSICXMLREADER_H
+#define MUSICXMLREADER_H
+
+#include "scoremodel.h"
+
+#include <QString>
+#include <QHash>
+#include <QXmlStreamReader>
+
+class QIODevice;
+
+// Reads partwise MusicXML (.xml, .musicxml) and compressed MusicXML (.mxl) with a pull parser, element
+// by element, so memory used depends on the number of notes and not on size of the file. Every part
+// becomes one voice and durations are converted from divisions of the file to ticks of the model.
+class MusicXmlReader
+{
+public:
+    static ScorePointer readFile(const QString &filename, const ProgressCallback &progress = nullptr);
+    static ScorePointer read(QIODevice *device, const ProgressCallback &progress = nullptr);
+
+private:
+    struct Note
+    {
+        qint64 onset;
+        qint64 duration;
+        int pitch;
+        int velocity;
+    };
+
+    MusicXmlReader(QIODevice *device, QIODevice *file, const ProgressCallback &progress);
+
+    static ScorePointer read(QIODevice *device, QIODevice *file, const ProgressCallback &progress);
+
+    bool readScore();
+    void readPart();
+    void readMeasure();
+    void readAttributes();
+    void readNote();
+    void readDirection();
+    void readSound();
+    qint64 readDuration(); // of element having duration child, like backup and forward
+    int readPitch();
+    qint64 toTicks(const QString &divisions) const;
+
+    void reportProgress();
+    void addNote(const Note &note);
+    void flushTiedNotes();
+
+    static QIODevice *openCompressedScore(QIODevice *archive);
+
+    // ----------
+
+    QXmlStreamReader m_xml;
+    QSharedPointer<ScoreModel> m_score;
+    QIODevice *m_file = nullptr; // read position in it is progress; archive for compressed scores
+    ProgressCallback m_progress;
+
+    // state of part being read, positions in ticks
+    int m_voice = 0;
+    double m_divisions = 1; // per quarter
+    int m_velocity = m_default_velocity;
+    qint64 m_position = 0;
+    qint64 m_measure_end = 0;
+    qint64 m_chord_onset = 0;
+    QHash<int, Note> m_tied_notes; // by pitch, waiting for their tie to end
+
+    static const int m_default_velocity = 64;
+    static constexpr double m_forte_velocity = 90; // dynamics of MusicXML are percents of it
+};
+
+#endif // MUSICXMLREADER_H
@@ -0,0 +1,58 @@
+// Author:  Jakub Precht
+
+#ifndef PITCHQUANTIZER_H
+#define PITCHQUANTIZER_H
+
+#include <QtGlobal>
+#include <cstring>
+
+// Maps detected pitch to midi note number directly from 12 * log2(pitch / reference), in constant time.
+// A note keeps being detected while pitch stays within its band widened by hysteresis, so pitches
+// wobbling around the boundary of two notes do not flip between them.
+class PitchQuantizer
+{
+public:
+    explicit PitchQuantizer(float reference_pitch = m_default_reference_pitch, float hysteresis_cents = 0);
+
+    void setReferencePitch(float reference_pitch); // of a' (midi 69), in Hz
+    void setHysteresis(float hysteresis_cents);
+    float referencePitch() const;
+
+    // cents (if given) is deviation of pitch from the returned note
+    inline int quantize(float pitch, int current_note, float *cents = nullptr) const;
+
+    static inline float fastLog2(float x);
+
+    static constexpr float m_default_reference_pitch = 440;
+
+private:
+    float m_reference_pitch = m_default_reference_pitch;
+    float m_log2_reference = 0;
+    float m_hysteresis = 0; // in semitones
+};
+
+int PitchQuantizer::quantize(float pitch, int current_note, float *cents) const
+{
+    const float semitones = 69 + 12 * (fastLog2(qMax(pitch, 1.f)) - m_log2_reference);
+    int note = current_note;
+    if (qAbs(semitones - current_note) > 0.5f + m_hysteresis)
+        note = qBound(0, static_cast<int>(semitones + 0.5f), 127);
+    if (cents != nullptr)
+        *cents = (semitones - note) * 100;
+    return note;
+}
+
+float PitchQuantizer::fastLog2(float x)
+{
+    // exponent read from bits of float, mantissa in [0.5, 1) approximated by rational function;
+    // error below 0.2 cents over the range of musical pitches
+    quint32 bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    const quint32 mantissa_bits = (bits & 0x007fffffu) | 0x3f000000u;
+    float mantissa;
+    std::memcpy(&mantissa, &mantissa_bits, sizeof(mantissa));
+    return bits * 1.1920928955078125e-7f - 124.22551499f - 1.498030302f * mantissa
+            - 1.72587999f / (0.3520887068f + mantissa);
+}
+
+#endif // PITCHQUANTIZER_H
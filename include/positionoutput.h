@@ -0,0 +1,86 @@
+// Author:  Jakub Precht
+
+#ifndef POSITIONOUTPUT_H
+#define POSITIONOUTPUT_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QVector>
+#include <QWebSocketServer>
+
+class QWebSocket;
+
+// Publishes position, page and tempo to local consumers (page turners, stage displays, lighting cues) as
+// OSC bundles over UDP and JSON messages over a WebSocket on localhost. Changes are batched: a subscriber
+// gets one message with the latest state, and at most one per interval. A WebSocket client which has not
+// received its previous message yet is skipped until it has, so a slow consumer gets fewer updates
+// instead of growing a queue, and the follower never waits for anyone.
+//
+// OSC bundle (immediate time tag): /scorefollower/position i, /scorefollower/page i, /scorefollower/tempo f
+// WebSocket text message:          {"position":12,"page":2,"tempo":3.5}
+// Position is the number of played notes, tempo is in notes per second (0 when unknown).
+class PositionOutput : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PositionOutput(QObject *parent = nullptr);
+
+    // osc targets are "host:port", web socket port 0 disables it, interval is in ms
+    bool configure(const QVector<QString> &osc_targets, int web_socket_port, int interval);
+    void publish(int position, int page, float notes_per_second); // cheap, sending is deferred when due
+
+private slots:
+    void acceptConnection();
+    void flush();
+
+private:
+    struct State
+    {
+        int position = 0;
+        int page = 0;
+        float tempo = 0;
+
+        bool operator==(const State &other) const
+        {
+            return position == other.position && page == other.page && tempo == other.tempo;
+        }
+    };
+
+    struct OscTarget
+    {
+        QHostAddress address;
+        quint16 port = 0;
+        State sent;
+        bool has_sent = false;
+    };
+
+    struct Client
+    {
+        QWebSocket *socket = nullptr;
+        State sent;
+        bool has_sent = false;
+        qint64 unwritten = 0; // bytes of sent messages still waiting in socket
+    };
+
+    bool listen(int port);
+    void schedule();
+    QByteArray oscBundle() const;
+    QString jsonMessage() const;
+    static void appendOscMessage(QByteArray &bundle, const QByteArray &address, char type, quint32 value);
+    static void appendOscString(QByteArray &data, const QByteArray &string);
+    static void appendBigEndian(QByteArray &data, quint32 value);
+
+    // ----------
+
+    State m_state;
+    QVector<OscTarget> m_osc_targets;
+    QVector<Client> m_clients;
+    QUdpSocket m_udp_socket;
+    QWebSocketServer m_web_socket_server;
+    QTimer m_flush_timer; // runs while some subscriber is behind, so none gets more than one message per tick
+};
+
+#endif // POSITIONOUTPUT_H
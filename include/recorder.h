@@ -3,14 +3,27 @@
 #ifndef RECORDER_H
 #define RECORDER_H
 
-#include <essentia/algorithmfactory.h>
+#include "channelfollower.h"
+#include "latestvalue.h"
+#include "scoreloader.h"
+#include "settings.h"
 
 #include <QTimer>
 #include <QAudioRecorder>
 #include <QAudioProbe>
 #include <QAudioInput>
 
-class Settings;
+#include <atomic>
+
+// Totals of processed buffers, written by recorder thread and read by reports of other threads
+struct RecorderStatistics
+{
+    std::atomic<quint64> buffers_received { 0 }; // by audio probe, before queued to recorder
+    std::atomic<quint64> buffers_processed { 0 };
+    std::atomic<qint64> cpu_time { 0 }; // of recorder thread in processBuffer, in ns
+    std::atomic<qint64> processing_time { 0 }; // wall time in processBuffer, in ns
+    std::atomic<qint64> max_processing_time { 0 }; // of one buffer, reset by reader
+};
 
 class Recorder : public QObject
 {
@@ -18,36 +31,47 @@ class Recorder : public QObject
 
 public:
     Recorder(QObject *parent = nullptr);
+    ~Recorder();
     bool initialize();
-    void setScore(const QVector<int> &score_notes);
     void resetDtw();
-    void setSettings(const Settings *settings);
+    void setSettingsSource(SettingsSource *source); // registers recorder as its reader
     void setAudioInput(QString audio_input);
+    void setOutputs(LatestValue<int> *position, LatestValue<qint64> *position_time, LatestValue<float> *level);
+    RecorderStatistics &statistics(); // safe to read from any thread
 
 public slots:
     void startFollowing();
     void stopFollowing();
+    void setScore(LoadedScore score);
     void processBuffer(const QAudioBuffer buffer);
 
-signals:
-    void positionChanged(int position);
-    void levelChanged(float level);
+private slots:
+    void restartInput();
 
 private:
-    void initializePitchDetector();
-    int findNoteFromPitch(float pitch);
+    friend class KernelsBenchmark; // measures private kernels in isolation
+
+    void updateSettings();
+    void createChannels();
+    void deleteChannels();
+    void followBuffer(const QAudioBuffer &buffer);
     void calculatePosition();
     void calculateMaxAmplitude();
     void updateLevel(const QAudioBuffer &buffer);
     void convertBufferToAudio(const QAudioBuffer &buffer);
-    void processFrame();
     void setMaxAmplitude(const QAudioFormat &format);
 
     // ----------
 
     // recording
 
-    const Settings *m_settings;
+    SettingsSource *m_settings_source = nullptr; // published by gui
+    int m_settings_reader = 0;
+    quint64 m_settings_generation = 0;
+    const Settings *m_settings = nullptr; // snapshot in use, replaced only between buffers, kept alive by source
+    LatestValue<int> *m_position_output = nullptr; // read by gui once per frame
+    LatestValue<qint64> *m_position_time_output = nullptr; // arrival of buffer which moved position
+    LatestValue<float> *m_level_output = nullptr;
     bool m_is_following = false;
     QTimer *m_timer = nullptr;
     QAudioProbe *m_probe = nullptr;
@@ -55,6 +79,8 @@ private:
     QAudioInput *m_audio_input = nullptr;
     QAudioFormat m_current_format;
     QAudioEncoderSettings m_recorder_settings;
+    QString m_audio_input_name; // empty for default input
+    RecorderStatistics m_statistics;
 
     float m_max_amplitude = 1;
     float m_level = 0;
@@ -63,32 +89,17 @@ private:
 
     // position
 
-    int m_position = 0;
+    qint64 m_buffer_time = 0; // arrival of buffer being processed, see Latency
+    qint64 m_next_buffer_start = -1; // stream time expected from next buffer, in us
+    int m_position = 0; // published played notes, -1 to publish next one whatever it is
     qint64 m_current_second = 0;
     int m_samples_in_current_second = 0;
-    QVector<int> m_score_notes;
-    QVector<int64_t> m_dtw_row;
-    QVector<int64_t> m_next_row;
-
-    // essentia
-
-    const int64_t m_infinity = std::numeric_limits<int64_t>::max();
-    int m_buffer_size = 0;
-    int m_current_note_number = 0;
-    float m_current_pitch = 0;
-    float m_current_confidence = 0;
-    bool m_last_was_skipped = false;
-    int m_last_skipped_note = 0;
-    int m_skipped_count = 0;
-
-    std::deque<float> m_memory;
-    std::vector<float> m_audio_frame;
-    std::vector<float> m_spectrum;
-    std::vector<float> m_windowed_frame;
-
-    essentia::standard::Algorithm* m_window_calculator;
-    essentia::standard::Algorithm* m_spectrum_calculator;
-    essentia::standard::Algorithm* m_pitch_detector;
+    ScorePointer m_score;
+
+    // channels, followed in parallel when there are more of them
+
+    QVector<ChannelFollower *> m_channels; // one per channel part in settings
+    std::vector<float> m_channel_values; // of one sample frame, by input channel
 };
 
 #endif // RECORDER_H
@@ -0,0 +1,38 @@
+// Author:  Jakub Precht
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <QtGlobal>
+
+#include <vector>
+
+struct SRC_STATE_tag;
+
+// Streaming conversion of one mono stream from the rate of audio input to the analysis rate, with band
+// limited sinc interpolation of libsamplerate. Converter state and output buffer are allocated when rates
+// are set, so converting blocks of up to maxInput samples never allocates.
+class Resampler
+{
+public:
+    Resampler() = default;
+    ~Resampler();
+
+    bool setRates(int input_rate, int output_rate); // false when converter cannot be created
+    bool isActive() const; // rates differ
+    void reset(); // forgets filter history, as after a gap in audio
+
+    int process(const float *input, int count); // returns number of converted samples, count <= maxInput
+    const float *output() const; // converted samples, valid until next process
+
+    static const int m_max_input = 8192; // samples
+
+private:
+    Q_DISABLE_COPY(Resampler)
+
+    SRC_STATE_tag *m_state = nullptr;
+    double m_ratio = 1; // output rate / input rate
+    std::vector<float> m_output;
+};
+
+#endif // RESAMPLER_H
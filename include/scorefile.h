@@ -0,0 +1,52 @@
+// Author:  Jakub Precht
+
+#ifndef SCOREFILE_H
+#define SCOREFILE_H
+
+#include "scoremodel.h"
+
+#include <QString>
+
+// Precompiled score format (".sfs"). Header with table of sections is followed by raw score arrays
+// aligned to 8 bytes, so a score is used straight from the mapped file without parsing or copying and
+// the mapping is shared by all processes having the same score open.
+class ScoreFile
+{
+public:
+    static bool write(const ScoreModel &score, const QString &filename);
+    static ScorePointer map(const QString &filename);
+
+    static const char m_extension[];
+
+private:
+    enum class Section : quint32 {
+        Onsets = 1, Durations, Pitches, Velocities, Voices, ChordGroups, TempoTicks, Tempos, TempoSeconds
+    };
+
+    struct SectionEntry
+    {
+        quint32 id;
+        quint32 element_size;
+        quint64 offset;
+        quint64 count;
+    };
+
+    struct Header
+    {
+        char magic[4];
+        quint32 version;
+        quint32 byte_order_mark; // format is native, file from other endianness is rejected
+        qint32 ticks_per_quarter;
+        quint32 notes_count;
+        quint32 tempo_changes_count;
+        quint32 sections_count; // entries follow header, unknown ones are skipped
+        quint32 reserved;
+    };
+
+    static const char m_magic[4];
+    static const quint32 m_version = 1;
+    static const quint32 m_byte_order_mark = 0x01020304;
+    static const quint64 m_alignment = 8;
+};
+
+#endif // SCOREFILE_H
@@ -0,0 +1,32 @@
+// Author:  Jakub Precht
+
+#ifndef SCOREIMAGEPROVIDER_H
+#define SCOREIMAGEPROVIDER_H
+
+#include <QQuickImageProvider>
+#include <QVector>
+#include <QImage>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QSvgRenderer>
+
+// Serves rendered score pages from memory under "image://score/<revision>/<page>".
+// Bitmap pages are stored already decoded, so QML never touches the disk on a page turn.
+// Svg pages are kept parsed and painted in the size requested by QML, so they stay sharp at any zoom.
+class ScoreImageProvider : public QQuickImageProvider
+{
+public:
+    ScoreImageProvider();
+
+    void setPages(const QVector<QImage> &pages);
+    void setVectorPages(const QVector<QByteArray> &documents, const QSize &page_size);
+    QImage requestImage(const QString &id, QSize *size, const QSize &requested_size) override;
+
+private:
+    QMutex m_mutex; // requestImage is called from QML image loader threads
+    QVector<QImage> m_pages;
+    QVector<QSharedPointer<QSvgRenderer>> m_vector_pages;
+    QSize m_page_size;
+};
+
+#endif // SCOREIMAGEPROVIDER_H
@@ -0,0 +1,30 @@
+// Author:  Jakub Precht
+
+#ifndef SCORELAYOUT_H
+#define SCORELAYOUT_H
+
+#include <QVector>
+
+// Position of every note slot on rendered pages, resolved once after each render. Page, x and y are
+// kept in separate arrays indexed by note, so every lookup is a single read.
+class ScoreLayout
+{
+public:
+    void build(const QVector<QVector<int>> &indicator_ys, const QVector<int> &indicator_xs);
+
+    int notesCount() const;
+    int pagesNumber() const;
+    int page(int note) const;
+    int x(int note) const;
+    int y(int note) const;
+    int pageFirstNote(int page) const;
+    int pageNotesCount(int page) const;
+
+private:
+    QVector<int> m_pages; // numbered from 1
+    QVector<int> m_xs;
+    QVector<int> m_ys;
+    QVector<int> m_page_first_notes = { 0 }; // for each page and one past the last one
+};
+
+#endif // SCORELAYOUT_H
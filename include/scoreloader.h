@@ -0,0 +1,51 @@
+// Author:  Jakub Precht
+
+#ifndef SCORELOADER_H
+#define SCORELOADER_H
+
+#include "scoremodel.h"
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+// Rows of dtw allocated by loader, owned by nobody else, so follower swaps them in without any copy
+struct DtwRows
+{
+    QVector<int64_t> dtw_row;
+    QVector<int64_t> next_row;
+};
+
+// Score with everything follower needs already allocated, so installing it is only a few swaps. Copies
+// made by queued connections share the rows object and not the vectors inside it.
+struct LoadedScore
+{
+    QString filename;
+    ScorePointer score = ScorePointer::create();
+    QSharedPointer<DtwRows> rows = QSharedPointer<DtwRows>::create();
+};
+
+Q_DECLARE_METATYPE(LoadedScore)
+
+// Reads and prepares scores on its own thread, so neither gui nor audio waits for parsing
+class ScoreLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ScoreLoader(QObject *parent = nullptr);
+
+public slots:
+    void loadScore(const QString &filename);
+
+signals:
+    void progressChanged(float progress); // from 0 to 1
+    void finishedLoading(LoadedScore score);
+
+private:
+    static const int m_progress_interval = 250; // ms between reports while reading
+    static constexpr float m_reading_share = 0.95f; // of progress, the rest is allocation of rows
+};
+
+#endif // SCORELOADER_H
@@ -0,0 +1,90 @@
+// Author:  Jakub Precht
+
+#ifndef SCOREMODEL_H
+#define SCOREMODEL_H
+
+#include <QVector>
+#include <QSharedPointer>
+#include <QMetaType>
+#include <QFile>
+
+#include <functional>
+
+// Plain views of score arrays, either into vectors of ScoreModel or into a mapped score file
+struct ScoreArrays
+{
+    int notes_count = 0;
+    const qint64 *onsets = nullptr; // in ticks
+    const qint32 *durations = nullptr; // in ticks
+    const quint8 *pitches = nullptr; // midi note numbers
+    const quint8 *velocities = nullptr;
+    const quint8 *voices = nullptr; // track or part number
+    const qint32 *chord_groups = nullptr;
+
+    int tempo_changes_count = 0;
+    const qint64 *tempo_ticks = nullptr;
+    const qint32 *tempos = nullptr; // microseconds per quarter, from corresponding tick on
+    const double *tempo_seconds = nullptr; // time at corresponding tick
+};
+
+// Notes of a score sorted by onset, every property kept in its own array. Notes starting at the same
+// tick form one chord group. Once loaded it is shared read only (see ScorePointer) by all threads.
+class ScoreModel
+{
+public:
+    explicit ScoreModel(int ticks_per_quarter = m_default_ticks_per_quarter);
+    // arrays stay valid as long as the file is mapped
+    ScoreModel(int ticks_per_quarter, const ScoreArrays &arrays, const QSharedPointer<QFile> &mapped_file);
+
+    void addNote(qint64 onset, qint32 duration, int pitch, int velocity, int voice);
+    void addTempoChange(qint64 tick, qint32 microseconds_per_quarter);
+    void finish();
+
+    int size() const;
+    bool isEmpty() const;
+    int ticksPerQuarter() const;
+    int voicesCount() const;
+    double seconds(qint64 tick) const;
+
+    const qint64 *onsets() const;
+    const qint32 *durations() const;
+    const quint8 *pitches() const;
+    const quint8 *velocities() const;
+    const quint8 *voices() const;
+    const qint32 *chordGroups() const;
+
+    int pitch(int note) const;
+    const ScoreArrays &arrays() const;
+
+    static const int m_default_ticks_per_quarter = 480;
+    static const qint32 m_default_tempo = 500000; // microseconds per quarter, 120 bpm
+
+private:
+    Q_DISABLE_COPY(ScoreModel) // arrays may point into own vectors
+
+    int m_ticks_per_quarter;
+    ScoreArrays m_arrays; // used by all accessors
+    QSharedPointer<QFile> m_mapped_file;
+
+    // storage of scores built by readers, empty for mapped ones
+
+    QVector<qint64> m_onsets;
+    QVector<qint32> m_durations;
+    QVector<quint8> m_pitches;
+    QVector<quint8> m_velocities;
+    QVector<quint8> m_voices;
+    QVector<qint32> m_chord_groups;
+
+    QVector<qint64> m_tempo_ticks;
+    QVector<qint32> m_tempos;
+    QVector<double> m_tempo_seconds;
+};
+
+using ScorePointer = QSharedPointer<const ScoreModel>;
+
+// readers report through it how much of the file they have read, from 0 to 1
+using ProgressCallback = std::function<void(float)>;
+
+Q_DECLARE_METATYPE(ScorePointer)
+
+#endif // SCOREMODEL_H
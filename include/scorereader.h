@@ -3,18 +3,20 @@
 #ifndef SCOREREADER_H
 #define SCOREREADER_H
 
+#include "scoremodel.h"
+
 #include <QString>
 
 class ScoreReader
 {
 public:
-    static QVector<int> readScoreFile(const QString &filename);
+    static ScorePointer readScoreFile(const QString &filename, const ProgressCallback &progress = nullptr);
 
 private:
-    static QVector<int> readMidiFile(const QString &filename);
-    static QVector<int> readTextFile(const QString &filename);
+    static ScorePointer readMidiFile(const QString &filename, const ProgressCallback &progress);
+    static ScorePointer readTextFile(const QString &filename, const ProgressCallback &progress);
 
-    static int m_midi_note_on_action_code;
+    static const int m_percussion_channel = 9; // general midi channel 10, key numbers there are not pitches
 };
 
 #endif // SCOREREADER_H
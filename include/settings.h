@@ -7,26 +7,57 @@
 #include <QVector>
 #include <QJsonObject>
 
+#include <atomic>
+#include <deque>
+#include <memory>
+
+// Input channels mixed together and the part of the score their sound is aligned with
+struct ChannelPart
+{
+    QVector<int> channels; // indices of captured channels, from 0
+    int part = 0; // voice of score plus one, 0 for whole score
+
+    bool operator==(const ChannelPart &other) const
+    {
+        return channels == other.channels && part == other.part;
+    }
+};
+
 class Settings
 {
 public:
     bool readSettings();
+    bool readSettings(const QString &filename);
+    static QString settingsFilename(); // of user settings, default ones are used when it is missing
+    bool hasSameLayout(const Settings &other) const; // whether score rendered with either looks the same
+
     int sampleRate() const;
+    int inputChannels() const;
     int frameSize() const;
     int hopSize() const;
     float confidenceCoefficient() const;
     float confidenceShift() const;
+    float referencePitch() const;
+    float pitchHysteresis() const;
     int indicatorWidth() const;
     int indicatorHeight() const;
     int staffIndent() const;
     int notesPerStaff() const;
     int staffsPerPage() const;
     int dpi() const;
+    int lilypondServers() const;
+    bool vectorScore() const;
+    bool halfPageTurn() const;
+    float pageTurnLeadTime() const;
+    int metricsPort() const; // 0 when metrics are not served
+    int webSocketPort() const; // 0 when position is not published over web socket
+    int outputInterval() const; // ms
 
     const QVector<float>& minimalConfidence() const;
-    const QVector<QPair<float, float>>& notesFrequencyBoundry() const;
+    const QVector<ChannelPart>& channelParts() const;
     const QVector<int>& indicatorXs() const;
     const QVector<QString>& lilypondNotesNotation() const;
+    const QVector<QString>& oscTargets() const;
 
     const QString& lilypondWorkingDirectory() const;
     const QString& lilypondHeader() const;
@@ -36,11 +67,12 @@ public:
     void setVerbose(bool verbose);
 
 private:
-    bool readSettings(const QString &filename);
     double readNumber(const QString &name);
     QString readString(const QString &name);
     bool readNotes();
+    bool readChannelParts();
     bool readIndicatorXPositions();
+    bool readOscTargets();
 
     // ----------
 
@@ -52,12 +84,15 @@ private:
     // essentia
 
     int m_sample_rate = 0;
+    int m_input_channels = 0;
     int m_frame_size = 0;
     int m_hop_size = 0;
     float m_confidence_coefficient = 0;
     float m_confidence_shift = 0;
+    float m_reference_pitch = 0;
+    float m_pitch_hysteresis = 0; // in cents
     QVector<float> m_minimal_confidence;
-    QVector<QPair<float, float>> m_notes_frequency_boundry;
+    QVector<ChannelPart> m_channel_parts;
 
     // lilypond and gui
 
@@ -67,12 +102,60 @@ private:
     int m_notes_per_staff = 0;
     int m_staffs_per_page = 0;
     int m_dpi = 0;
+    int m_lilypond_servers = 0;
+    bool m_vector_score = false;
+    bool m_half_page_turn = false;
+    float m_page_turn_lead_time = 0;
     QVector<int> m_indicator_xs;
     QVector<QString> m_lilypond_notes_notation;
 
     QString m_lilypond_working_directory;
     QString m_lilypond_header;
     QString m_lilypond_footer;
+
+    // monitoring
+
+    int m_metrics_port = 0;
+
+    // position output
+
+    QVector<QString> m_osc_targets;
+    int m_web_socket_port = 0;
+    int m_output_interval = 0;
+};
+
+// Settings are never modified once read. Reloading publishes a new snapshot through SettingsSource and
+// worker threads pick it up at points where switching is safe for them.
+using SettingsPointer = std::shared_ptr<const Settings>;
+
+// Publishes settings snapshots from the owning (gui) thread. Audio threads register as readers and pick up
+// the latest snapshot with two atomic loads, no lock or reference count taken; they acknowledge it once
+// they no longer use older ones. Owning thread keeps every snapshot a reader may still use and frees the
+// rest itself, so no snapshot is ever freed on audio path. Other threads may take a shared snapshot.
+class SettingsSource
+{
+public:
+    SettingsSource() = default;
+
+    // owning thread
+    void publish(const SettingsPointer &settings);
+    void retire(); // frees snapshots every reader has acknowledged a newer one than, publish does it too
+    int addReader(); // before reader starts reading
+
+    // reader threads
+    const Settings *latest(quint64 &generation) const; // generation 0 until anything is published
+    void acknowledge(int reader, quint64 generation); // reader uses no older snapshot any more
+
+    SettingsPointer snapshot() const; // any thread, for those not on audio path
+
+private:
+    Q_DISABLE_COPY(SettingsSource)
+
+    std::atomic<const Settings *> m_latest { nullptr };
+    std::atomic<quint64> m_generation { 0 };
+    std::deque<std::atomic<quint64>> m_acknowledged; // by reader, deque as atomics cannot move
+    SettingsPointer m_snapshot; // accessed only with std::atomic_* functions
+    std::deque<std::pair<quint64, SettingsPointer>> m_published; // kept alive until acknowledged
 };
 
 #endif // SETTINGS_H
@@ -0,0 +1,67 @@
+// Author:  Jakub Precht
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "latency.h"
+
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+class QMutex;
+
+// Timeline of pipeline stages for chrome://tracing or Perfetto. Scopes marked with TRACE_SCOPE are stored
+// as complete events into fixed buffer of the recording thread, without locks or allocations, and the
+// timeline is written as Chrome Trace Event JSON when tracing stops. While tracing is off a scope costs
+// one relaxed load, so marks stay compiled in.
+class Trace
+{
+public:
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name)
+            : m_name(isEnabled() ? name : nullptr), m_begin(m_name != nullptr ? Latency::now() : 0) { }
+        ~Scope()
+        {
+            if (m_name != nullptr)
+                complete(m_name, m_begin, Latency::now());
+        }
+
+    private:
+        Q_DISABLE_COPY(Scope)
+
+        const char *m_name;
+        qint64 m_begin;
+    };
+
+    static bool isEnabled()
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    static void start();
+    static bool stop(const QString &filename); // writes all events recorded since start
+    // event of stage spanning more than one scope, times from Latency::now; name has to be a literal
+    static void complete(const char *name, qint64 begin, qint64 end);
+
+private:
+    struct ThreadEvents;
+    static ThreadEvents &threadEvents();
+
+    // events of all threads that ever recorded, kept after threads finish so they are written
+    static QMutex m_registry_mutex;
+    static QVector<ThreadEvents *> m_registry;
+    static std::atomic<bool> m_enabled;
+    static qint64 m_start_time;
+
+    static const int m_capacity = 1 << 17; // events per thread, later ones are dropped
+};
+
+#define TRACE_CONCAT(a, b) a##b
+#define TRACE_SCOPE_NAME(line) TRACE_CONCAT(trace_scope_, line)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_SCOPE_NAME(__LINE__)(name)
+
+#endif // TRACE_H
@@ -2,30 +2,31 @@
 
 import QtQuick 2.5
 import QtQuick.Layouts 1.3
+import QtQuick.Window 2.3
+import ScoreFollower 1.0
 
 Item {
-    property int imageWidth: 932;
-    property int imageHeight: 661;
+    property int imageWidth: controller.pageWidth;
+    property int imageHeight: controller.pageHeight;
+    // svg pages are painted for the screen, so they can grow beyond their size at settings dpi
+    property real maximumScale: controller.vectorScore ? Number.POSITIVE_INFINITY : 1;
 
     function updateScore() {
+        pageArea.updateSourceSize();
         updatePage();
-        createIndicators(controller.scoreLength);
     }
 
-    function updatePage() {
-        scoreImage.source = "";
-        scoreImage.source = "file:///tmp/score-follower/score-page" + controller.currentPage + ".png";
+    function pageSource(page) {
+        if (page < 1 || page > controller.pagesNumber)
+            return "";
+        return "image://score/" + controller.scoreRevision + "/" + page;
     }
 
-    function createIndicators(count) {
-        indicators.children = "";
-        var indicatorComponent = Qt.createComponent("Indicator.qml");
-        for (var index = 0; index < count; index++) {
-            var object = indicatorComponent.createObject(indicators);
-            object.indicatorX = controller.indicatorX(index);
-            object.indicatorY = controller.indicatorY(index);
-            object.position = index + 1;
-        }
+    // neighbouring pages stay loaded (and uploaded) underneath current one, so page turn only swaps textures
+    function updatePage() {
+        previousImage.source = pageSource(controller.currentPage - 1);
+        scoreImage.source = pageSource(controller.currentPage);
+        nextImage.source = pageSource(controller.currentPage + 1);
     }
 
     Connections {
@@ -39,23 +40,116 @@ Item {
     RowLayout {
         anchors.fill: parent
 
-        Image {
-            id: scoreImage
+        Item {
+            id: pageArea
             width: imageWidth;
             height: imageHeight;
-            fillMode: Image.PreserveAspectFit
 
             Layout.preferredWidth: parent.width;
             Layout.preferredHeight: parent.height;
-            Layout.maximumWidth: imageWidth;
-            Layout.maximumHeight: imageHeight;
+            Layout.maximumWidth: imageWidth * maximumScale;
+            Layout.maximumHeight: imageHeight * maximumScale;
             Layout.alignment: Qt.AlignHCenter | Qt.AlignVCenter;
 
+            // ignored for bitmap pages, svg pages are painted in this size; it follows the item only once
+            // resizing settles, until then painted pages are scaled
+            property size pageSourceSize: Qt.size(0, 0);
+
+            function updateSourceSize() {
+                pageSourceSize = controller.vectorScore
+                        ? Qt.size(Math.ceil(width * Screen.devicePixelRatio), Math.ceil(height * Screen.devicePixelRatio))
+                        : Qt.size(0, 0);
+            }
+
+            onWidthChanged: sourceSizeTimer.restart();
+            onHeightChanged: sourceSizeTimer.restart();
+            Component.onCompleted: updateSourceSize();
+
+            Timer {
+                id: sourceSizeTimer;
+                interval: 200;
+                onTriggered: pageArea.updateSourceSize();
+            }
+
+            // current page as last painted, shown while a new size or page is painted off the gui thread
+            readonly property Image shownImage: scoreImage.status === Image.Ready ? scoreImage : lastScoreImage;
+
+            Image {
+                id: previousImage
+                anchors.fill: parent;
+                fillMode: Image.PreserveAspectFit
+                sourceSize: pageArea.pageSourceSize;
+                asynchronous: true;
+                z: 0;
+            }
+
+            Image {
+                id: nextImage
+                anchors.fill: parent;
+                fillMode: Image.PreserveAspectFit
+                sourceSize: pageArea.pageSourceSize;
+                asynchronous: true;
+                z: 0;
+            }
+
+            Image {
+                id: scoreImage
+                anchors.fill: parent;
+                fillMode: Image.PreserveAspectFit
+                sourceSize: pageArea.pageSourceSize;
+                asynchronous: true;
+                z: 1;
+
+                onStatusChanged: {
+                    if (status === Image.Ready) {
+                        // taken from pixmap cache, so it is ready at once
+                        lastScoreImage.sourceSize = sourceSize;
+                        lastScoreImage.source = source;
+                    }
+                }
+            }
+
+            Image {
+                id: lastScoreImage
+                anchors.fill: parent;
+                fillMode: Image.PreserveAspectFit
+                visible: scoreImage.status !== Image.Ready;
+                z: 1;
+            }
+
+            // half page turn: top half of next page over top half of current one
+            Item {
+                id: previewArea
+                width: pageArea.shownImage.paintedWidth;
+                height: pageArea.shownImage.paintedHeight / 2;
+                x: (pageArea.width - pageArea.shownImage.paintedWidth) / 2;
+                y: (pageArea.height - pageArea.shownImage.paintedHeight) / 2;
+                visible: controller.previewPage > 0;
+                clip: true;
+                z: 1;
+
+                Image {
+                    width: pageArea.shownImage.paintedWidth;
+                    height: pageArea.shownImage.paintedHeight;
+                    source: pageSource(controller.previewPage);
+                    sourceSize: pageArea.pageSourceSize;
+                    asynchronous: true; // usually next page already in pixmap cache, so shown at once
+                }
+
+                Rectangle {
+                    width: parent.width;
+                    height: 1;
+                    anchors.bottom: parent.bottom;
+                    color: "lightgrey";
+                }
+            }
+
             Rectangle {
                 id: indicators;
-                width: scoreImage.paintedWidth;
-                height: scoreImage.paintedHeight;
+                width: pageArea.shownImage.paintedWidth;
+                height: pageArea.shownImage.paintedHeight;
                 color: "transparent";
+                z: 2;
 
                 anchors.centerIn: parent;
                 onWidthChanged: {
@@ -64,6 +158,11 @@ Item {
                 onHeightChanged: {
                     controller.indicatorScale = Math.min(width / imageWidth, height / imageHeight);
                 }
+
+                IndicatorLayer {
+                    anchors.fill: parent;
+                    scoreController: controller;
+                }
             }
         }
     }
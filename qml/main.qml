@@ -44,6 +44,13 @@ ApplicationWindow {
             startButton.enabled = true;
             isLoading = false;
         }
+        onCancelledFileOpening: isLoading = false;
+    }
+
+    // latency statistics printed on demand
+    Shortcut {
+        sequence: "Ctrl+L";
+        onActivated: controller.dumpLatency();
     }
 
     onWidthChanged: update();
@@ -178,4 +185,12 @@ ApplicationWindow {
         height: 100;
         anchors.centerIn: parent;
     }
+
+    ProgressBar {
+        visible: isLoading && controller.loadingProgress < 1;
+        width: 200;
+        value: controller.loadingProgress;
+        anchors.top: busyIndicator.bottom;
+        anchors.horizontalCenter: parent.horizontalCenter;
+    }
 }
@@ -7,26 +7,65 @@ MIDIFILE_PATH = /opt/midifile
 CONFIG += c++14 file_copies
 QMAKE_CXXFLAGS += -O2 -Wall -Wshadow -Wpedantic -Wextra
 
-QT += quick core multimedia widgets quickcontrols2
+QT += quick core multimedia widgets quickcontrols2 svg concurrent network websockets
 
 DEFINES += QT_DEPRECATED_WARNINGS
 
 INCLUDEPATH += include
 
 HEADERS += \
+    include/audiolog.h \
+    include/calibrator.h \
+    include/channelfollower.h \
     include/controller.h \
+    include/followerserver.h \
+    include/indicatorlayer.h \
+    include/latency.h \
+    include/latestvalue.h \
     include/lilypond.h \
+    include/lilypondserver.h \
+    include/metrics.h \
+    include/metricsserver.h \
+    include/musicxmlreader.h \
+    include/pitchquantizer.h \
+    include/positionoutput.h \
     include/recorder.h \
+    include/resampler.h \
+    include/scorefile.h \
+    include/scoreimageprovider.h \
+    include/scoreloader.h \
+    include/scorelayout.h \
+    include/scoremodel.h \
     include/scorereader.h \
-    include/settings.h
+    include/settings.h \
+    include/trace.h
 
 SOURCES += \
     src/main.cpp \
+    src/audiolog.cpp \
+    src/calibrator.cpp \
+    src/channelfollower.cpp \
     src/controller.cpp \
+    src/followerserver.cpp \
+    src/indicatorlayer.cpp \
+    src/latency.cpp \
     src/lilypond.cpp \
+    src/lilypondserver.cpp \
+    src/metrics.cpp \
+    src/metricsserver.cpp \
+    src/musicxmlreader.cpp \
+    src/pitchquantizer.cpp \
+    src/positionoutput.cpp \
     src/recorder.cpp \
+    src/resampler.cpp \
+    src/scorefile.cpp \
+    src/scoreimageprovider.cpp \
+    src/scoreloader.cpp \
+    src/scorelayout.cpp \
+    src/scoremodel.cpp \
     src/scorereader.cpp \
-    src/settings.cpp
+    src/settings.cpp \
+    src/trace.cpp
 
 RESOURCES += \
     resources.qrc
@@ -43,6 +82,9 @@ INCLUDEPATH += $$MIDIFILE_PATH/include
 DEPENDPATH += $$MIDIFILE_PATH/include
 PRE_TARGETDEPS += $$MIDIFILE_PATH/lib/libmidifile.a
 
+# zlib, for compressed MusicXML
+LIBS += -lz
+
 # copy settings.json to build direcotry
 COPIES += settings
 settings.files = $$files(other/settings.json)
@@ -0,0 +1,135 @@
+// Author:  Jakub Precht
+
+#include "audiolog.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QThread>
+
+// bounded queue of D. Vyukov: every cell carries a sequence number telling whether it is free for the
+// writer which claimed its position or already filled for the reader, so neither side needs a lock
+struct AudioLog::Ring
+{
+    Ring()
+    {
+        for (quint32 i = 0; i < m_capacity; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    struct Cell
+    {
+        std::atomic<quint32> sequence;
+        Record record;
+    };
+
+    Cell cells[m_capacity];
+    std::atomic<quint32> head { 0 }; // next position to write
+    quint32 tail = 0; // next position to read, only by formatting thread
+    std::atomic<quint64> dropped { 0 };
+};
+
+class AudioLog::Formatter : public QThread
+{
+protected:
+    void run() override
+    {
+        while (!isInterruptionRequested()) {
+            drain();
+            msleep(m_poll_interval);
+        }
+        drain();
+    }
+};
+
+AudioLog::Ring AudioLog::m_ring;
+QThread *AudioLog::m_formatter = nullptr;
+const quint32 AudioLog::m_capacity;
+
+void AudioLog::write(Message message, qint32 first, qint32 second, float value)
+{
+    quint32 position = m_ring.head.load(std::memory_order_relaxed);
+    Ring::Cell *cell = nullptr;
+    for (;;) {
+        cell = &m_ring.cells[position & (m_capacity - 1)];
+        const qint32 difference = static_cast<qint32>(cell->sequence.load(std::memory_order_acquire) - position);
+        if (difference == 0) {
+            if (m_ring.head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                break;
+        } else if (difference < 0) {
+            m_ring.dropped.fetch_add(1, std::memory_order_relaxed); // full, reader is a lap behind
+            return;
+        } else {
+            position = m_ring.head.load(std::memory_order_relaxed); // taken by other writer
+        }
+    }
+    cell->record = { QDateTime::currentMSecsSinceEpoch(), message, first, second, value };
+    cell->sequence.store(position + 1, std::memory_order_release);
+}
+
+void AudioLog::start()
+{
+    if (m_formatter != nullptr)
+        return;
+    m_formatter = new Formatter();
+    m_formatter->setObjectName("log");
+    m_formatter->start(QThread::LowPriority);
+}
+
+void AudioLog::stop()
+{
+    if (m_formatter == nullptr)
+        return;
+    m_formatter->requestInterruption();
+    m_formatter->wait();
+    delete m_formatter;
+    m_formatter = nullptr;
+}
+
+void AudioLog::drain()
+{
+    for (;;) {
+        Ring::Cell &cell = m_ring.cells[m_ring.tail & (m_capacity - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != m_ring.tail + 1)
+            break;
+        const Record record = cell.record;
+        cell.sequence.store(m_ring.tail + m_capacity, std::memory_order_release); // free for next lap
+        m_ring.tail++;
+        format(record);
+    }
+
+    const quint64 dropped = m_ring.dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0)
+        qWarning().nospace() << dropped << " audio log records were dropped.";
+}
+
+void AudioLog::format(const Record &record)
+{
+    switch (record.message) {
+    case NoteDetected:
+        qInfo().nospace() << "Detected note " << record.first << " (" << record.second << " cents).";
+        break;
+    case NoteSkipped:
+        qInfo().nospace() << "Note " << record.first << " was skipped " << record.second << " times (<"
+                          << record.value << ").";
+        break;
+    case SamplesPerSecond:
+        qInfo().nospace().noquote() << QDateTime::fromMSecsSinceEpoch(record.time).toString("hh:mm:ss")
+                                    << ": " << record.first << " samples.";
+        break;
+    case BufferSize:
+        qInfo().nospace() << "Buffer size: " << record.first << '.';
+        break;
+    case UnsupportedFormat:
+        qDebug() << "Unsupported audio format.";
+        break;
+    case ResamplingFailed:
+        qWarning().nospace() << "Resampling failed, libsamplerate error " << record.first << '.';
+        break;
+    case InputRate:
+        if (record.first == record.second)
+            qInfo().nospace() << "Audio input runs at " << record.first << " Hz.";
+        else
+            qInfo().nospace() << "Audio input runs at " << record.first << " Hz, resampled to " << record.second << " Hz.";
+        break;
+    }
+}
@@ -0,0 +1,270 @@
+// Author:  Jakub Precht
+
+#include "calibrator.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QRegularExpression>
+#include <QThread>
+#include <QtConcurrent>
+
+#include <essentia/algorithmfactory.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace essentia;
+using namespace standard;
+
+Calibrator::Calibrator(const SettingsPointer &settings)
+    : m_settings(settings), m_pitch_quantizer(settings->referencePitch())
+{
+    essentia::init();
+}
+
+bool Calibrator::calibrate(const QString &recording, const QString &annotations)
+{
+    std::vector<float> audio;
+    if (!loadAudio(recording, audio))
+        return false;
+
+    QVector<Frame> frames = analyse(audio);
+    if (annotations.isEmpty())
+        labelFromSteadyNotes(frames);
+    else if (!labelFromAnnotations(annotations, frames))
+        return false;
+
+    const QVector<float> confidences = averageConfidences(frames);
+    if (std::none_of(confidences.begin(), confidences.end(), [](float confidence){ return confidence >= 0; })) {
+        qWarning() << "No note was played long enough to be calibrated.";
+        return false;
+    }
+    return writeSettings(confidences);
+}
+
+bool Calibrator::loadAudio(const QString &recording, std::vector<float> &audio) const
+{
+    if (!QFileInfo::exists(recording)) {
+        qWarning() << "File don't exists: " << recording;
+        return false;
+    }
+
+    // decoded and resampled to the rate recorder works with
+    Algorithm *loader = AlgorithmFactory::instance().create("MonoLoader",
+                                                            "filename", recording.toStdString(),
+                                                            "sampleRate", m_settings->sampleRate());
+    loader->output("audio").set(audio);
+    try {
+        loader->compute();
+    } catch (const EssentiaException &exception) {
+        qWarning() << "Failed to load recording: " << exception.what();
+        delete loader;
+        return false;
+    }
+    delete loader;
+
+    if (audio.size() < static_cast<size_t>(m_settings->frameSize())) {
+        qWarning() << "Recording is shorter than one frame: " << recording;
+        return false;
+    }
+    return true;
+}
+
+QVector<Calibrator::Frame> Calibrator::analyse(const std::vector<float> &audio) const
+{
+    const int frame_size = m_settings->frameSize();
+    const int hop_size = m_settings->hopSize();
+    const int frames_count = static_cast<int>((audio.size() - frame_size) / hop_size + 1);
+    QVector<Frame> frames(frames_count);
+
+    // each chunk of frames gets its own chain, algorithms are created up front as factory is not
+    // meant to be used from many threads
+    struct Chunk
+    {
+        int begin;
+        int end;
+        std::vector<float> audio_frame;
+        std::vector<float> windowed_frame;
+        std::vector<float> spectrum;
+        float pitch = 0;
+        float confidence = 0;
+        Algorithm *window_calculator;
+        Algorithm *spectrum_calculator;
+        Algorithm *pitch_detector;
+    };
+
+    AlgorithmFactory &factory = AlgorithmFactory::instance();
+    const int chunks_count = qMax(1, qMin(QThread::idealThreadCount(), frames_count));
+    QVector<Chunk> chunks(chunks_count);
+    for (int i = 0; i < chunks_count; i++) {
+        Chunk &chunk = chunks[i];
+        chunk.begin = static_cast<int>(static_cast<qint64>(frames_count) * i / chunks_count);
+        chunk.end = static_cast<int>(static_cast<qint64>(frames_count) * (i + 1) / chunks_count);
+        chunk.window_calculator = factory.create("Windowing", "type", "hann", "zeroPadding", 0);
+        chunk.spectrum_calculator = factory.create("Spectrum", "size", frame_size);
+        chunk.pitch_detector = factory.create("PitchYinFFT", "frameSize", frame_size,
+                                              "sampleRate", m_settings->sampleRate());
+    }
+
+    QtConcurrent::blockingMap(chunks, [&](Chunk &chunk){
+        chunk.window_calculator->input("frame").set(chunk.audio_frame);
+        chunk.window_calculator->output("frame").set(chunk.windowed_frame);
+        chunk.spectrum_calculator->input("frame").set(chunk.windowed_frame);
+        chunk.spectrum_calculator->output("spectrum").set(chunk.spectrum);
+        chunk.pitch_detector->input("spectrum").set(chunk.spectrum);
+        chunk.pitch_detector->output("pitch").set(chunk.pitch);
+        chunk.pitch_detector->output("pitchConfidence").set(chunk.confidence);
+
+        for (int i = chunk.begin; i < chunk.end; i++) {
+            const auto frame_begin = audio.begin() + static_cast<qint64>(i) * hop_size;
+            chunk.audio_frame.assign(frame_begin, frame_begin + frame_size);
+            chunk.window_calculator->compute();
+            chunk.spectrum_calculator->compute();
+            chunk.pitch_detector->compute();
+            frames[i].pitch = chunk.pitch;
+            frames[i].confidence = chunk.confidence;
+            frames[i].note = m_pitch_quantizer.quantize(chunk.pitch, 0);
+        }
+    });
+
+    for (auto &chunk : chunks) {
+        delete chunk.window_calculator;
+        delete chunk.spectrum_calculator;
+        delete chunk.pitch_detector;
+    }
+    return frames;
+}
+
+bool Calibrator::labelFromAnnotations(const QString &annotations, QVector<Frame> &frames) const
+{
+    QFile file(annotations);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open: " << annotations;
+        return false;
+    }
+
+    // frame belongs to a note when its whole window lies within the note
+    const double frame_seconds = static_cast<double>(m_settings->frameSize()) / m_settings->sampleRate();
+    const double hop_seconds = static_cast<double>(m_settings->hopSize()) / m_settings->sampleRate();
+    QTextStream in(&file);
+    int line_number = 0;
+    while (!in.atEnd()) {
+        const QString line = in.readLine().section('#', 0, 0).trimmed();
+        line_number++;
+        if (line.isEmpty())
+            continue;
+
+        const QStringList pieces = line.split(QRegularExpression("\\s+"));
+        bool ok1 = false, ok2 = false, ok3 = false;
+        const double start = pieces.value(0).toDouble(&ok1);
+        const double end = pieces.value(1).toDouble(&ok2);
+        const int note = pieces.value(2).toInt(&ok3);
+        if (pieces.size() != 3 || !ok1 || !ok2 || !ok3 || note < 0 || note >= m_notes_count) {
+            qWarning().nospace() << "Invalid annotation in line " << line_number << ": " << line;
+            return false;
+        }
+
+        const int first = qMax(0, static_cast<int>(std::ceil(start / hop_seconds)));
+        const int last = qMin(frames.size() - 1, static_cast<int>(std::floor((end - frame_seconds) / hop_seconds)));
+        for (int i = first; i <= last; i++)
+            frames[i].expected_note = note;
+    }
+    return true;
+}
+
+void Calibrator::labelFromSteadyNotes(QVector<Frame> &frames) const
+{
+    auto is_steady = [&](const Frame &frame, int note) {
+        return frame.note == note && frame.confidence >= m_minimal_run_confidence;
+    };
+
+    for (int begin = 0; begin < frames.size(); ) {
+        int end = begin;
+        while (end < frames.size() && is_steady(frames[end], frames[begin].note))
+            end++;
+        if (end - begin >= m_minimal_run) {
+            for (int i = begin; i < end; i++)
+                frames[i].expected_note = frames[i].note;
+        }
+        begin = qMax(end, begin + 1);
+    }
+}
+
+QVector<float> Calibrator::averageConfidences(const QVector<Frame> &frames) const
+{
+    QVector<QVector<float>> detected(m_notes_count); // confidences of correctly detected frames
+    QVector<int> expected(m_notes_count, 0);
+    for (auto &frame : frames) {
+        if (frame.expected_note < 0)
+            continue;
+        expected[frame.expected_note]++;
+        if (frame.note == frame.expected_note)
+            detected[frame.expected_note].push_back(frame.confidence);
+    }
+
+    QVector<float> confidences(m_notes_count, -1);
+    const QVector<QString> &notation = m_settings->lilypondNotesNotation();
+    for (int note = 0; note < m_notes_count; note++) {
+        QVector<float> &values = detected[note];
+        if (values.size() < m_minimal_frames) {
+            if (expected[note] > 0)
+                qInfo().nospace() << "Note " << note << " skipped, only " << values.size() << " frames detected.";
+            continue;
+        }
+
+        std::sort(values.begin(), values.end());
+        confidences[note] = std::accumulate(values.begin(), values.end(), 0.f) / values.size();
+        qInfo().nospace().noquote() << "Note " << note << " (" << notation.value(note) << "): "
+                                    << values.size() << " of " << expected[note] << " frames detected, confidence "
+                                    << "average " << confidences[note] << ", 10th percentile "
+                                    << values[values.size() / 10] << ".";
+    }
+    return confidences;
+}
+
+bool Calibrator::writeSettings(const QVector<float> &confidences) const
+{
+    // user settings are updated in place, keeping comments and layout; first calibration starts from defaults
+    const QString filename = Settings::settingsFilename();
+    QFile source(QFileInfo::exists(filename) ? filename : QString(":/other/settings.json"));
+    if (!source.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open: " << source.fileName();
+        return false;
+    }
+    QStringList lines = QString::fromUtf8(source.readAll()).split('\n');
+    source.close();
+
+    // row of notes table: [ number, frequency, confidence, notation ]
+    const QRegularExpression row("^(\\s*\\[\\s*(\\d+)\\s*,\\s*[^,]+,\\s*)([^,\\s]+),(\\s*)(.*)$");
+    int updated = 0;
+    for (auto &line : lines) {
+        const QRegularExpressionMatch match = row.match(line);
+        if (!match.hasMatch())
+            continue;
+        const int note = match.captured(2).toInt();
+        if (note < 0 || note >= confidences.size() || confidences[note] < 0)
+            continue;
+
+        const QString value = QString::number(confidences[note], 'f', 4);
+        const int width = match.captured(3).size() + match.captured(4).size();
+        line = match.captured(1) + value + ',' + QString(qMax(1, width - value.size()), ' ') + match.captured(5);
+        updated++;
+    }
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open: " << filename;
+        return false;
+    }
+    file.write(lines.join('\n').toUtf8());
+    if (!file.commit()) {
+        qWarning() << "Failed to write: " << filename;
+        return false;
+    }
+    qInfo().nospace() << "Calibrated " << updated << " notes in " << filename << ".";
+    return true;
+}
@@ -0,0 +1,246 @@
+// Author:  Jakub Precht
+
+#include "channelfollower.h"
+#include "audiolog.h"
+#include "latency.h"
+#include "metrics.h"
+#include "trace.h"
+
+using namespace essentia;
+using namespace standard;
+
+ChannelFollower::ChannelFollower(const ChannelPart &channel_part)
+    : m_channel_part(channel_part), m_mix_scale(1.f / channel_part.channels.size())
+{
+}
+
+ChannelFollower::~ChannelFollower()
+{
+    deletePitchDetector();
+}
+
+void ChannelFollower::setSettings(const Settings *settings)
+{
+    // pitch detector (with its fft) and frame buffers depend only on frame size and sample rate
+    const bool rebuild_detector = m_settings == nullptr || settings->frameSize() != m_settings->frameSize()
+            || settings->sampleRate() != m_settings->sampleRate();
+    m_settings = settings;
+    m_frame_size = static_cast<size_t>(m_settings->frameSize());
+
+    m_pitch_quantizer.setReferencePitch(m_settings->referencePitch());
+    m_pitch_quantizer.setHysteresis(m_settings->pitchHysteresis());
+    if (rebuild_detector) {
+        deletePitchDetector();
+        m_audio_frame.clear();
+        m_memory.clear();
+        initializePitchDetector();
+        if (m_input_rate > 0)
+            setInputRate(m_input_rate); // analysis rate may have changed
+    }
+}
+
+void ChannelFollower::setInputRate(int input_rate)
+{
+    m_input_rate = input_rate;
+    m_input_size = 0;
+    if (!m_resampler.setRates(m_input_rate, m_settings->sampleRate()))
+        return; // samples are analysed as they are, with pitch off by the ratio of rates
+    if (m_resampler.isActive())
+        m_input.resize(Resampler::m_max_input);
+}
+
+void ChannelFollower::resetInput()
+{
+    m_input_size = 0;
+    m_resampler.reset();
+}
+
+void ChannelFollower::resampleInput()
+{
+    TRACE_SCOPE("resampling");
+    const int count = m_resampler.process(m_input.data(), static_cast<int>(m_input_size));
+    const float *output = m_resampler.output();
+    for (int i = 0; i < count; i++)
+        addAnalysisSample(output[i]);
+    m_input_size = 0;
+}
+
+void ChannelFollower::initializePitchDetector()
+{
+    AlgorithmFactory& factory = AlgorithmFactory::instance();
+
+    m_window_calculator = factory.create("Windowing", "type", "hann", "zeroPadding", 0);
+    m_spectrum_calculator = factory.create("Spectrum", "size", m_settings->frameSize());
+    m_pitch_detector = factory.create("PitchYinFFT",
+                                      "frameSize", m_settings->frameSize(),
+                                      "sampleRate", m_settings->sampleRate());
+
+    m_window_calculator->input("frame").set(m_audio_frame);
+    m_window_calculator->output("frame").set(m_windowed_frame);
+
+    m_spectrum_calculator->input("frame").set(m_windowed_frame);
+    m_spectrum_calculator->output("spectrum").set(m_spectrum);
+
+    m_pitch_detector->input("spectrum").set(m_spectrum);
+    m_pitch_detector->output("pitch").set(m_current_pitch);
+    m_pitch_detector->output("pitchConfidence").set(m_current_confidence);
+}
+
+void ChannelFollower::deletePitchDetector()
+{
+    delete m_window_calculator;
+    delete m_spectrum_calculator;
+    delete m_pitch_detector;
+    m_window_calculator = nullptr;
+    m_spectrum_calculator = nullptr;
+    m_pitch_detector = nullptr;
+}
+
+void ChannelFollower::setScore(const LoadedScore &score)
+{
+    m_score = score.score;
+    m_part_pitches.clear();
+    m_part_notes.clear();
+    m_pitches = m_score->pitches();
+    int notes = m_score->size();
+    if (m_channel_part.part > 0) {
+        const quint8 *voices = m_score->voices();
+        for (int i = 0; i < m_score->size(); i++) {
+            if (voices[i] == m_channel_part.part - 1) {
+                m_part_pitches.push_back(m_score->pitches()[i]);
+                m_part_notes.push_back(i);
+            }
+        }
+        m_pitches = m_part_pitches.constData();
+        notes = m_part_pitches.size();
+    }
+
+    // rows of loaded score are swapped in, every other follower (and every part) allocates its own
+    DtwRows &rows = *score.rows;
+    if (rows.dtw_row.size() == notes && rows.next_row.size() == notes) {
+        m_dtw_row.swap(rows.dtw_row);
+        m_next_row.swap(rows.next_row);
+    } else {
+        m_dtw_row.fill(0, notes);
+        m_next_row.fill(0, notes);
+    }
+    reset();
+}
+
+void ChannelFollower::reset()
+{
+    m_position = -1;
+    m_dtw_row.fill(0);
+}
+
+const ChannelPart &ChannelFollower::channelPart() const
+{
+    return m_channel_part;
+}
+
+float ChannelFollower::mixScale() const
+{
+    return m_mix_scale;
+}
+
+int ChannelFollower::playedNotes() const
+{
+    if (m_position < 0)
+        return 0;
+    return (m_part_notes.isEmpty() ? m_position : m_part_notes[m_position]) + 1;
+}
+
+void ChannelFollower::follow(qint64 buffer_time)
+{
+    m_buffer_time = buffer_time;
+    if (m_input_size > 0)
+        resampleInput();
+    while (m_audio_frame.size() + m_memory.size() >= m_frame_size) {
+        while (m_audio_frame.size() < m_frame_size) {
+            m_audio_frame.push_back(m_memory.front());
+            m_memory.pop_front();
+        }
+        processFrame();
+        m_audio_frame.erase(m_audio_frame.begin(), m_audio_frame.begin() + m_settings->hopSize());
+    }
+    while (!m_memory.empty()) {
+        m_audio_frame.push_back(m_memory.front());
+        m_memory.pop_front();
+    }
+}
+
+void ChannelFollower::processFrame()
+{
+    TRACE_SCOPE("frame");
+    {
+        TRACE_SCOPE("windowing");
+        m_window_calculator->compute();
+    }
+    {
+        TRACE_SCOPE("spectrum");
+        m_spectrum_calculator->compute();
+    }
+    {
+        TRACE_SCOPE("pitch");
+        m_pitch_detector->compute();
+    }
+    Latency::record(Latency::FrameCompleted, m_buffer_time);
+    Metrics::add(Metrics::FramesProcessed);
+
+    float cents = 0;
+    const int note_number = m_pitch_quantizer.quantize(m_current_pitch, m_current_note_number, &cents);
+    if (note_number != m_current_note_number) {
+        if (m_current_confidence >= m_settings->minimalConfidence()[note_number]) {
+            m_current_note_number = note_number;
+            m_current_cents = cents;
+            Latency::record(Latency::PitchDecided, m_buffer_time);
+            Metrics::add(Metrics::NotesDetected);
+            calculatePosition();
+
+            if (m_settings->verbose() && m_last_was_skipped) {
+                AudioLog::write(AudioLog::NoteSkipped, m_last_skipped_note, m_skipped_count,
+                                m_settings->minimalConfidence()[note_number]);
+                m_last_was_skipped = false;
+            }
+
+            AudioLog::write(AudioLog::NoteDetected, note_number, qRound(m_current_cents));
+        }
+        else {
+            Metrics::add(Metrics::FramesLowConfidence);
+            if (m_settings->verbose()) {
+                if (m_last_was_skipped && m_last_skipped_note != note_number) {
+                    AudioLog::write(AudioLog::NoteSkipped, m_last_skipped_note, m_skipped_count,
+                                    m_settings->minimalConfidence()[note_number]);
+                    m_skipped_count = 0;
+                }
+                m_last_was_skipped = true;
+                m_last_skipped_note = note_number;
+                m_skipped_count++;
+            }
+        }
+    }
+}
+
+void ChannelFollower::calculatePosition()
+{
+    TRACE_SCOPE("dtw");
+    if (m_dtw_row.isEmpty())
+        return;
+
+    // dtw algorithm
+    m_next_row[0] = qAbs(m_current_note_number - m_pitches[0]) + m_dtw_row[0];
+
+    int position = 0;
+    int64_t min_value = m_next_row[0];
+    for (int i = 1; i < m_dtw_row.size(); i++) {
+        m_next_row[i] = qAbs(m_current_note_number - m_pitches[i]) + qMin(m_next_row[i - 1], qMin(m_dtw_row[i], m_dtw_row[i-1]));
+        if (m_next_row[i] < min_value) {
+            position = i;
+            min_value = m_next_row[i];
+        }
+    }
+
+    m_dtw_row.swap(m_next_row); // fast swap
+    m_position = position;
+    Metrics::set(Metrics::DtwCostPerNote, static_cast<double>(min_value) / (position + 1));
+}
@@ -1,58 +1,110 @@
 // Author:  Jakub Precht
 
 #include "controller.h"
-#include "scorereader.h"
 #include "settings.h"
+#include "latency.h"
+#include "trace.h"
 
 #include <QDebug>
 #include <QVector>
 #include <QTimer>
 #include <QFile>
+#include <QFileInfo>
 #include <QFileDialog>
 #include <QStandardPaths>
 
 Controller::Controller(bool verbose, QObject *parent)
-    : QObject(parent), m_lilypond(new Lilypond()), m_recorder(new Recorder())
+    : QObject(parent), m_lilypond(new Lilypond()), m_recorder(new Recorder()),
+      m_loader(new ScoreLoader()), m_image_provider(new ScoreImageProvider())
 {
-    Settings *settings = new Settings();
+    auto settings = std::make_shared<Settings>();
     settings->setVerbose(verbose);
     m_status = settings->readSettings();
     if (!m_status)
         return;
     m_settings = settings;
-    m_lilypond->setSettings(settings);
-    m_recorder->setSettings(settings);
+    m_published_settings.publish(m_settings);
+    m_lilypond->setSettingsSource(&m_published_settings);
+    m_recorder->setSettingsSource(&m_published_settings);
+    m_recorder->setOutputs(&m_position_input, &m_position_time_input, &m_level_input);
     m_status &= m_recorder->initialize();
 
     m_lilypond->moveToThread(&m_lilypond_thread);
     m_recorder->moveToThread(&m_recorder_thread);
+    m_loader->moveToThread(&m_loader_thread);
 
     connect(this, &Controller::startRecording, m_recorder, &Recorder::startFollowing);
     connect(this, &Controller::stopRecording, m_recorder, &Recorder::stopFollowing);
-    connect(this, &Controller::generateScore, m_lilypond, &Lilypond::generateScore);
-    connect(m_recorder, &Recorder::positionChanged, [=](int position){ setPlayedNotes(position); });
-    connect(m_recorder, &Recorder::levelChanged, [=](float level){ setLevel(level); });
-
-    connect(m_lilypond, &Lilypond::finishedGeneratingScore, [=](int pages_count, QVector<QVector<int>> indicator_ys){
+    connect(this, &Controller::generateScore, m_lilypond, &Lilypond::requestScore);
+    connect(&m_lilypond_thread, &QThread::started, m_lilypond, &Lilypond::startServers);
+
+    // loaded score goes to recorder and lilypond through their queues, never touching them mid-buffer
+    qRegisterMetaType<ScorePointer>();
+    qRegisterMetaType<LoadedScore>();
+    connect(this, &Controller::loadScore, m_loader, &ScoreLoader::loadScore);
+    connect(m_loader, &ScoreLoader::finishedLoading, this, &Controller::finishLoading);
+    connect(m_loader, &ScoreLoader::progressChanged, this, [=](float progress){
+        m_loading_progress = progress;
+        emit loadingProgressChanged();
+    });
+    connect(this, &Controller::installScore, m_recorder, &Recorder::setScore);
+    connect(this, &Controller::installScoreModel, m_lilypond, &Lilypond::setScore);
+
+    // without frames being rendered (not following) recorder is still sampled for level bar
+    m_idle_poll_timer.setInterval(m_idle_poll_interval);
+    connect(&m_idle_poll_timer, &QTimer::timeout, this, &Controller::pollRecorder);
+    m_idle_poll_timer.start();
+
+    qRegisterMetaType<RenderedScore>();
+    connect(m_lilypond, &Lilypond::finishedGeneratingScore, this, [=](RenderedScore score){
+        if (score.generation != m_render_generation)
+            return; // result of outdated request
+
+        if (m_settings->vectorScore())
+            m_image_provider->setVectorPages(score.vector_pages, score.page_size);
+        else
+            m_image_provider->setPages(score.pages);
+        m_score_revision++;
+        m_page_size = score.page_size;
         m_current_page = 1;
-        m_indicator_ys = indicator_ys;
-        setPagesNumber(pages_count);
+        m_preview_page = 0;
+        m_layout.build(score.indicator_ys, m_settings->indicatorXs());
+        setPagesNumber(m_layout.pagesNumber());
+        publishPosition();
         emit currentPageChanged();
+        emit previewPageChanged();
         emit updateScore();
     });
 
-    connect(&m_timer, &QTimer::timeout, [=](){ emit generateScore(); });
+    connect(&m_timer, &QTimer::timeout, this, &Controller::requestScore);
 
+    // settings edited on disk are applied without restart
+    m_settings_timer.setSingleShot(true);
+    m_settings_timer.setInterval(m_settings_reload_delay);
+    connect(&m_settings_timer, &QTimer::timeout, this, &Controller::reloadSettings);
+    connect(&m_settings_watcher, &QFileSystemWatcher::fileChanged, &m_settings_timer, [=]{
+        m_settings_timer.start();
+    });
+    if (QFileInfo::exists(Settings::settingsFilename()))
+        m_settings_watcher.addPath(Settings::settingsFilename());
+    m_metrics_server.listen(m_settings->metricsPort());
+    m_position_output.configure(m_settings->oscTargets(), m_settings->webSocketPort(), m_settings->outputInterval());
+
+    // names show up in traces and debuggers
+    m_recorder_thread.setObjectName("recorder");
+    m_lilypond_thread.setObjectName("lilypond");
+    m_loader_thread.setObjectName("loader");
     m_recorder_thread.start();
     m_lilypond_thread.start();
+    m_loader_thread.start();
 }
 
 Controller::~Controller()
 {
     m_lilypond_thread.quit();
     m_recorder_thread.quit();
+    m_loader_thread.quit();
     QThread::msleep(100);
-    delete m_settings;
 }
 
 bool Controller::createdSuccessfully() const
@@ -60,23 +112,113 @@ bool Controller::createdSuccessfully() const
     return m_status;
 }
 
+void Controller::attachWindow(QQuickWindow *window)
+{
+    m_window = window;
+    if (m_window == nullptr)
+        return;
+
+    connect(m_window, &QQuickWindow::afterAnimating, this, &Controller::pollRecorder);
+    // emitted on render thread; frame already being rendered when position moved is counted as well
+    connect(m_window, &QQuickWindow::frameSwapped, this, [=]{
+        const qint64 position_time = m_unpainted_position_time.exchange(0, std::memory_order_relaxed);
+        if (position_time != 0)
+            Latency::record(Latency::FrameSwapped, position_time);
+    }, Qt::DirectConnection);
+}
+
+void Controller::pollRecorder()
+{
+    m_published_settings.retire(); // snapshots recorder moved past are freed here, not on audio path
+
+    // at most one update of position and level per displayed frame, however often recorder writes them
+    int position = 0;
+    if (m_position_input.take(position)) {
+        TRACE_SCOPE("qml update");
+        setPlayedNotes(position);
+        // positions stored without time (reset when following starts) measure nothing
+        qint64 position_time = 0;
+        if (m_position_time_input.take(position_time) && position_time > 0) {
+            Latency::record(Latency::PlayedNotesSet, position_time);
+            m_unpainted_position_time.store(position_time, std::memory_order_relaxed);
+        }
+    }
+    float level = 0;
+    if (m_level_input.take(level))
+        setLevel(level);
+
+    // keep frames (and so sampling) going in sync with display while following
+    if (m_follow && m_window != nullptr)
+        m_window->update();
+}
+
 bool Controller::openScore()
 {
     m_file_to_open = QFileDialog::getOpenFileName(nullptr, "Open Score",
                                                   QStandardPaths::writableLocation(QStandardPaths::MusicLocation),
-                                                  "Score Files (*.txt *.mid);; All Files (*.*)");
+                                                  "Score Files (*.txt *.mid *.xml *.musicxml *.mxl *.sfs);; All Files (*.*)");
     if (m_file_to_open == "")
         return false;
 
-    QVector<int> score_notes = ScoreReader::readScoreFile(m_file_to_open);
-    m_lilypond->setScore(score_notes);
-    m_recorder->setScore(score_notes);
-    setScoreLength(score_notes.size());
-
-    emit generateScore();
+    m_loading_progress = 0;
+    emit loadingProgressChanged();
+    emit loadScore(m_file_to_open);
     return true;
 }
 
+void Controller::finishLoading(LoadedScore score)
+{
+    if (score.filename != m_file_to_open)
+        return; // another score was opened meanwhile
+    if (score.score->isEmpty()) {
+        emit cancelledFileOpening();
+        return;
+    }
+
+    setScoreLength(score.score->size());
+    emit installScoreModel(score.score);
+    emit installScore(score);
+    requestScore();
+}
+
+void Controller::reloadSettings()
+{
+    // editors often save by replacing the file, which removes it from watcher
+    const QString filename = Settings::settingsFilename();
+    if (!m_settings_watcher.files().contains(filename) && QFileInfo::exists(filename))
+        m_settings_watcher.addPath(filename);
+
+    auto settings = std::make_shared<Settings>();
+    settings->setVerbose(m_settings->verbose());
+    if (!settings->readSettings(filename)) {
+        qWarning() << "Keeping current settings.";
+        return;
+    }
+
+    SettingsPointer previous = m_settings;
+    m_settings = settings;
+    m_published_settings.publish(m_settings);
+    qInfo() << "Settings reloaded.";
+
+    if (m_settings->indicatorWidth() != previous->indicatorWidth())
+        emit indicatorWidthChanged();
+    if (m_settings->indicatorHeight() != previous->indicatorHeight())
+        emit indicatorHeightChanged();
+    if (!m_settings->hasSameLayout(*previous) && m_score_length > 0)
+        requestScore();
+    if (m_settings->metricsPort() != previous->metricsPort())
+        m_metrics_server.listen(m_settings->metricsPort());
+    if (m_settings->oscTargets() != previous->oscTargets() || m_settings->webSocketPort() != previous->webSocketPort()
+            || m_settings->outputInterval() != previous->outputInterval())
+        m_position_output.configure(m_settings->oscTargets(), m_settings->webSocketPort(),
+                                    m_settings->outputInterval());
+}
+
+void Controller::requestScore()
+{
+    emit generateScore(++m_render_generation);
+}
+
 int Controller::playedNotes() const
 {
     return m_played_notes;
@@ -88,7 +230,9 @@ void Controller::setPlayedNotes(int played_notes)
         return;
 
     m_played_notes = played_notes;
+    updateTempo();
     updateCurrentPage();
+    publishPosition();
     emit playedNotesChanged();
 }
 
@@ -125,9 +269,13 @@ void Controller::setFollow(bool follow)
 
     m_follow = follow;
     if (follow == true) {
+        m_idle_poll_timer.stop();
         emit startRecording();
+        if (m_window != nullptr)
+            m_window->update();
     } else {
         emit stopRecording();
+        m_idle_poll_timer.start();
     }
 
     emit followChanged();
@@ -146,32 +294,12 @@ void Controller::setLevel(float level)
 
 int Controller::indicatorX(int index)
 {
-    if (index < 0 || m_settings->indicatorXs().size() == 0) {
-        qWarning() << "wrong indicator x index or empty x indicator vector";
-        return 0;
-    }
-    return m_settings->indicatorXs()[index % m_settings->indicatorXs().size()];
+    return m_layout.x(index);
 }
 
 int Controller::indicatorY(int index)
 {
-    if (m_settings->indicatorXs().size() == 0 || m_indicator_ys.size() == 0) {
-        qWarning() << "Empty indicator vectors";
-        return 0;
-    }
-
-    int page = 0;
-    while (page < m_pages_number && index >= m_indicator_ys[page].size() * m_settings->indicatorXs().size()) {
-        index -= m_indicator_ys[page].size() * m_settings->indicatorXs().size();
-        page++;
-    }
-
-    int y = index / m_settings->indicatorXs().size();
-    if (y < 0 || y >= m_indicator_ys[page].size()) {
-        qWarning() << "wrong indicator y index:" << index;
-        return 0;
-    }
-    return m_indicator_ys[page][y];
+    return m_layout.y(index);
 }
 
 int Controller::pagesNumber() const
@@ -189,6 +317,56 @@ int Controller::currentPage() const
     return m_current_page;
 }
 
+int Controller::previewPage() const
+{
+    return m_preview_page;
+}
+
+int Controller::pageFirstNote(int page) const
+{
+    return m_layout.pageFirstNote(page);
+}
+
+int Controller::pageNotesCount(int page) const
+{
+    return m_layout.pageNotesCount(page);
+}
+
+int Controller::scoreRevision() const
+{
+    return m_score_revision;
+}
+
+int Controller::pageWidth() const
+{
+    return m_page_size.width();
+}
+
+int Controller::pageHeight() const
+{
+    return m_page_size.height();
+}
+
+bool Controller::vectorScore() const
+{
+    return m_settings->vectorScore();
+}
+
+void Controller::dumpLatency() const
+{
+    qInfo().noquote() << Latency::report();
+}
+
+float Controller::loadingProgress() const
+{
+    return m_loading_progress;
+}
+
+ScoreImageProvider *Controller::imageProvider() const
+{
+    return m_image_provider;
+}
+
 void Controller::setPagesNumber(int pages_number)
 {
     if (m_pages_number == pages_number)
@@ -207,23 +385,84 @@ void Controller::setScoreLength(int score_length)
     emit scoreLengthChanged();
 }
 
+void Controller::updateTempo()
+{
+    if (!m_tempo_timer.isValid())
+        m_tempo_timer.start();
+    const qint64 time = m_tempo_timer.elapsed();
+    const qint64 elapsed = time - m_tempo_last_time;
+    const int advance = m_played_notes - m_tempo_last_position;
+
+    if (advance < 0) {
+        m_notes_per_second = 0; // jumped back, start estimating again
+    } else if (elapsed > 0 && elapsed < m_tempo_max_gap) {
+        const float notes_per_second = advance * 1000.f / elapsed;
+        if (m_notes_per_second == 0)
+            m_notes_per_second = notes_per_second;
+        else
+            m_notes_per_second = 0.7f * m_notes_per_second + 0.3f * notes_per_second;
+    }
+    m_tempo_last_time = time;
+    m_tempo_last_position = m_played_notes;
+}
+
 void Controller::updateCurrentPage()
 {
-    int index = m_played_notes;
-    int page = 0;
-    while (page < m_pages_number && index > m_indicator_ys[page].size() * m_settings->indicatorXs().size()) {
-        index -= m_indicator_ys[page].size() * m_settings->indicatorXs().size();
-        page++;
+    if (m_pages_number == 0)
+        return;
+
+    // page of last played note, or the first page when nothing was played yet
+    const int note = qMax(m_played_notes - 1, 0);
+    const int played_page = m_layout.page(note);
+    int page = played_page;
+    int preview_page = 0;
+    if (page < m_pages_number) {
+        const int notes_left = m_layout.pageFirstNote(page + 1) - m_played_notes;
+        if (m_settings->halfPageTurn()) {
+            if (notes_left <= 0)
+                page++;
+            else if (m_played_notes > 0 && m_layout.y(note) >= m_page_size.height() / 2)
+                preview_page = page + 1;
+        } else if (isPageTurnDue(notes_left)) {
+            page++;
+        }
     }
-    if (page + 1!= m_current_page) {
-        m_current_page = page + 1;
+
+    // page turned early stays turned while tempo estimate drops (long note, fermata), it goes back only when
+    // played position itself goes back to an earlier page
+    if (played_page >= m_played_page)
+        page = qMax(page, m_current_page);
+    m_played_page = played_page;
+
+    if (page != m_current_page) {
+        m_current_page = page;
         emit currentPageChanged();
     }
+    if (preview_page != m_preview_page) {
+        m_preview_page = preview_page;
+        emit previewPageChanged();
+    }
+}
+
+bool Controller::isPageTurnDue(int notes_left) const
+{
+    if (notes_left <= 0)
+        return true; // next note to play is already on next page
+    if (m_notes_per_second == 0)
+        return false;
+    return notes_left / m_notes_per_second < m_settings->pageTurnLeadTime();
 }
 
 void Controller::resetPageAndPosition()
 {
     setPlayedNotes(0);
     m_current_page = 1;
+    publishPosition();
     emit currentPageChanged();
 }
+
+void Controller::publishPosition()
+{
+    // external page turners, displays and lighting follow the same position as the view
+    m_position_output.publish(m_played_notes, m_current_page, m_notes_per_second);
+}
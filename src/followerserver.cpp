@@ -0,0 +1,156 @@
+// Author:  Jakub Precht
+
+#include "followerserver.h"
+#include "scorereader.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+FollowerServer::FollowerServer(QObject *parent)
+    : QObject(parent), m_report_timer(this)
+{
+    m_report_timer.setInterval(m_report_interval);
+    connect(&m_report_timer, &QTimer::timeout, this, &FollowerServer::report);
+}
+
+FollowerServer::~FollowerServer()
+{
+    for (auto worker : m_workers) {
+        worker->quit();
+        worker->wait();
+    }
+    for (auto session : m_sessions)
+        delete session->recorder; // its thread is finished, so it can be deleted from here
+    qDeleteAll(m_sessions);
+    qDeleteAll(m_workers);
+}
+
+bool FollowerServer::start(const QString &sessions_filename)
+{
+    auto settings = std::make_shared<Settings>();
+    if (!settings->readSettings())
+        return false;
+    m_settings = settings;
+    m_settings_source.publish(m_settings);
+    if (!readSessions(sessions_filename))
+        return false;
+
+    // recorders are created here, essentia algorithms (and fftw plans) must not be created concurrently
+    const int workers_count = qMax(1, qMin(QThread::idealThreadCount(), m_sessions.size()));
+    for (int i = 0; i < workers_count; i++) {
+        m_workers.push_back(new QThread());
+        m_workers.back()->setObjectName(QString("worker %1").arg(i + 1));
+    }
+    for (int i = 0; i < m_sessions.size(); i++) {
+        Session *session = m_sessions[i];
+        session->recorder = new Recorder();
+        session->recorder->setSettingsSource(&m_settings_source);
+        session->recorder->setOutputs(&session->position, &session->position_time, &session->level);
+        session->recorder->setAudioInput(session->audio_input);
+        if (!session->recorder->initialize()) {
+            qWarning().nospace().noquote() << "Failed to start session " << session->name << ".";
+            return false;
+        }
+
+        // follower state is per session, only the score is shared
+        LoadedScore loaded;
+        loaded.score = session->score;
+        loaded.rows->dtw_row.fill(0, session->score->size());
+        loaded.rows->next_row.fill(0, session->score->size());
+        session->recorder->setScore(loaded);
+        session->recorder->moveToThread(m_workers[i % workers_count]);
+        QMetaObject::invokeMethod(session->recorder, "startFollowing", Qt::QueuedConnection);
+    }
+    for (auto worker : m_workers)
+        worker->start();
+
+    qInfo().nospace() << "Following " << m_sessions.size() << " sessions on " << workers_count
+                      << " worker threads, " << m_scores.size() << " distinct scores.";
+    m_metrics_server.listen(m_settings->metricsPort());
+    m_report_clock.start();
+    m_report_timer.start();
+    return true;
+}
+
+bool FollowerServer::readSessions(const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open: " << filename;
+        return false;
+    }
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (document.isNull()) {
+        qWarning().nospace().noquote() << "Failed to parse " << filename << ": " << error.errorString() << ".";
+        return false;
+    }
+
+    // { "sessions": [ { "name": "room 1", "score": "etude.mid", "audioInput": "alsa:hw:1,0" }, ... ] }
+    const QJsonArray sessions = document.object().value("sessions").toArray();
+    const QDir directory = QFileInfo(filename).absoluteDir(); // relative score paths start here
+    for (const auto &value : sessions) {
+        const QJsonObject object = value.toObject();
+        auto session = new Session();
+        m_sessions.push_back(session);
+        session->name = object.value("name").toString(QString("session %1").arg(m_sessions.size()));
+        session->audio_input = object.value("audioInput").toString();
+        const QString score = object.value("score").toString();
+        session->score = readScore(score.isEmpty() ? score : directory.absoluteFilePath(score));
+        if (session->score->isEmpty()) {
+            qWarning().nospace().noquote() << "No notes read for session " << session->name << ".";
+            return false;
+        }
+    }
+    if (m_sessions.isEmpty()) {
+        qWarning() << "No sessions in: " << filename;
+        return false;
+    }
+    return true;
+}
+
+ScorePointer FollowerServer::readScore(const QString &filename)
+{
+    const QString path = QFileInfo(filename).canonicalFilePath();
+    if (path.isEmpty())
+        return ScorePointer::create();
+    if (!m_scores.contains(path))
+        m_scores.insert(path, ScoreReader::readScoreFile(path));
+    return m_scores.value(path);
+}
+
+void FollowerServer::report()
+{
+    // cpu is a share of one core; processing time includes waiting for the core when workers are busy
+    const qint64 elapsed = qMax<qint64>(1, m_report_clock.restart()) * 1000000; // ns
+    for (auto session : m_sessions) {
+        int position = 0;
+        if (session->position.take(position))
+            session->played_notes = position;
+
+        RecorderStatistics &statistics = session->recorder->statistics();
+        const quint64 buffers = statistics.buffers_processed.load(std::memory_order_acquire);
+        const qint64 cpu_time = statistics.cpu_time.load(std::memory_order_relaxed);
+        const qint64 processing_time = statistics.processing_time.load(std::memory_order_relaxed);
+        const qint64 max_processing_time = statistics.max_processing_time.exchange(0, std::memory_order_relaxed);
+        const qint64 queued = static_cast<qint64>(statistics.buffers_received.load(std::memory_order_relaxed) - buffers);
+
+        const quint64 new_buffers = buffers - session->reported_buffers;
+        const double cpu = 100. * (cpu_time - session->reported_cpu_time) / elapsed;
+        const double average = new_buffers > 0
+                ? (processing_time - session->reported_processing_time) / 1e6 / new_buffers : 0;
+        session->reported_buffers = buffers;
+        session->reported_cpu_time = cpu_time;
+        session->reported_processing_time = processing_time;
+
+        qInfo().noquote() << QString("%1: note %2 of %3, cpu %4%, %5 buffers, processing %6 ms (max %7 ms), %8 queued")
+                             .arg(session->name).arg(session->played_notes).arg(session->score->size())
+                             .arg(cpu, 0, 'f', 1).arg(new_buffers).arg(average, 0, 'f', 2)
+                             .arg(max_processing_time / 1e6, 0, 'f', 2).arg(qMax<qint64>(0, queued));
+    }
+}
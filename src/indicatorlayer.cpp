@@ -0,0 +1,164 @@
+// Author:  Jakub Precht
+
+#include "indicatorlayer.h"
+#include "controller.h"
+#include "trace.h"
+
+#include <QSGGeometryNode>
+#include <QSGTransformNode>
+#include <QSGFlatColorMaterial>
+#include <QMatrix4x4>
+
+IndicatorLayer::IndicatorLayer(QQuickItem *parent)
+    : QQuickItem(parent)
+{
+    setFlag(ItemHasContents, true);
+}
+
+QObject *IndicatorLayer::scoreController() const
+{
+    return m_controller;
+}
+
+void IndicatorLayer::setScoreController(QObject *object)
+{
+    Controller *controller = qobject_cast<Controller *>(object);
+    if (m_controller == controller)
+        return;
+
+    if (m_controller != nullptr)
+        disconnect(m_controller, nullptr, this, nullptr);
+    m_controller = controller;
+    if (m_controller != nullptr) {
+        connect(m_controller, &Controller::updateScore, this, &IndicatorLayer::updatePage);
+        connect(m_controller, &Controller::currentPageChanged, this, &IndicatorLayer::updatePage);
+        connect(m_controller, &Controller::playedNotesChanged, this, &IndicatorLayer::updatePosition);
+        connect(m_controller, &Controller::indicatorScaleChanged, this, &IndicatorLayer::updateScale);
+        connect(m_controller, &Controller::indicatorWidthChanged, this, &IndicatorLayer::updatePage);
+        connect(m_controller, &Controller::indicatorHeightChanged, this, &IndicatorLayer::updatePage);
+    }
+
+    updatePage();
+    updateScale();
+    emit scoreControllerChanged();
+}
+
+void IndicatorLayer::updatePage()
+{
+    m_first_note = 0;
+    m_positions.clear();
+    if (m_controller != nullptr && m_controller->pagesNumber() > 0) {
+        const int page = m_controller->currentPage();
+        m_first_note = m_controller->pageFirstNote(page);
+        const int count = qMin(m_controller->pageNotesCount(page), m_controller->scoreLength() - m_first_note);
+        m_positions.reserve(count);
+        for (int i = 0; i < count; i++)
+            m_positions.push_back({ m_controller->indicatorX(m_first_note + i), m_controller->indicatorY(m_first_note + i) });
+    }
+
+    m_page_dirty = true;
+    m_dirty_notes.clear();
+    m_highlighted_note = -1;
+    updatePosition();
+    update();
+}
+
+void IndicatorLayer::updatePosition()
+{
+    // indicator of note with index i is shown when i + 1 notes were played
+    int note = (m_controller != nullptr ? m_controller->playedNotes() - 1 - m_first_note : -1);
+    if (note < 0 || note >= m_positions.size())
+        note = -1;
+    if (note == m_highlighted_note)
+        return;
+
+    markNoteDirty(m_highlighted_note);
+    m_highlighted_note = note;
+    markNoteDirty(m_highlighted_note);
+    update();
+}
+
+void IndicatorLayer::updateScale()
+{
+    m_scale_dirty = true;
+    update();
+}
+
+void IndicatorLayer::markNoteDirty(int note)
+{
+    if (note >= 0 && !m_page_dirty)
+        m_dirty_notes.push_back(note);
+}
+
+QSGNode *IndicatorLayer::updatePaintNode(QSGNode *old_node, UpdatePaintNodeData *data)
+{
+    TRACE_SCOPE("indicator paint");
+    Q_UNUSED(data);
+
+    auto transform_node = static_cast<QSGTransformNode *>(old_node);
+    QSGGeometryNode *geometry_node = nullptr;
+    if (transform_node == nullptr) {
+        transform_node = new QSGTransformNode();
+        geometry_node = new QSGGeometryNode();
+
+        auto geometry = new QSGGeometry(QSGGeometry::defaultAttributes_Point2D(), 0);
+        geometry->setDrawingMode(QSGGeometry::DrawTriangles);
+        geometry_node->setGeometry(geometry);
+        geometry_node->setFlag(QSGNode::OwnsGeometry);
+
+        auto material = new QSGFlatColorMaterial();
+        material->setColor(QColor("orange"));
+        geometry_node->setMaterial(material);
+        geometry_node->setFlag(QSGNode::OwnsMaterial);
+
+        transform_node->appendChildNode(geometry_node);
+        m_page_dirty = true;
+        m_scale_dirty = true;
+    } else {
+        geometry_node = static_cast<QSGGeometryNode *>(transform_node->firstChild());
+    }
+
+    if (m_scale_dirty) {
+        QMatrix4x4 matrix;
+        const float scale = static_cast<float>(m_controller != nullptr ? m_controller->indicatorScale() : 1);
+        matrix.scale(scale, scale);
+        transform_node->setMatrix(matrix);
+        m_scale_dirty = false;
+    }
+
+    QSGGeometry *geometry = geometry_node->geometry();
+    if (m_page_dirty) {
+        geometry->allocate(m_positions.size() * m_vertices_per_note);
+        m_dirty_notes.clear();
+        for (int i = 0; i < m_positions.size(); i++)
+            m_dirty_notes.push_back(i);
+        m_page_dirty = false;
+    }
+    if (m_dirty_notes.isEmpty())
+        return transform_node;
+
+    // indicator is centered on the staff and twice its height, hidden ones are collapsed to a point
+    const float width = m_controller != nullptr ? m_controller->indicatorWidth() : 0;
+    const float height = m_controller != nullptr ? m_controller->indicatorHeight() : 0;
+    QSGGeometry::Point2D *vertices = geometry->vertexDataAsPoint2D();
+    for (int note : m_dirty_notes) {
+        const float x0 = m_positions[note].x();
+        const float y0 = m_positions[note].y() - height / 2;
+        const bool visible = (note == m_highlighted_note);
+        const float x1 = visible ? x0 + width : x0;
+        const float y1 = visible ? y0 + height * 2 : y0;
+
+        QSGGeometry::Point2D *quad = vertices + note * m_vertices_per_note;
+        quad[0].set(x0, y0);
+        quad[1].set(x1, y0);
+        quad[2].set(x0, y1);
+        quad[3].set(x1, y0);
+        quad[4].set(x1, y1);
+        quad[5].set(x0, y1);
+    }
+    m_dirty_notes.clear();
+
+    geometry->markVertexDataDirty();
+    geometry_node->markDirty(QSGNode::DirtyGeometry);
+    return transform_node;
+}
@@ -0,0 +1,103 @@
+// Author:  Jakub Precht
+
+#include "latency.h"
+
+#include <QMutex>
+#include <QVector>
+#include <QtAlgorithms>
+
+#include <atomic>
+
+struct Latency::ThreadHistograms
+{
+    ThreadHistograms()
+    {
+        for (auto &stage_counts : counts) {
+            for (auto &count : stage_counts)
+                count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<quint64> counts[StagesCount][m_buckets]; // written only by owning thread
+};
+
+QMutex Latency::m_registry_mutex;
+QVector<Latency::ThreadHistograms *> Latency::m_registry;
+const int Latency::m_buckets;
+
+Latency::ThreadHistograms &Latency::threadHistograms()
+{
+    thread_local ThreadHistograms *histograms = nullptr;
+    if (histograms == nullptr) {
+        histograms = new ThreadHistograms();
+        QMutexLocker locker(&m_registry_mutex);
+        m_registry.push_back(histograms);
+    }
+    return *histograms;
+}
+
+void Latency::record(Stage stage, qint64 since)
+{
+    std::atomic<quint64> &count = threadHistograms().counts[stage][bucket(now() - since)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // single writer
+}
+
+int Latency::bucket(qint64 nanoseconds)
+{
+    const quint64 value = static_cast<quint64>(qMax<qint64>(nanoseconds, 0) / 1000) + 1;
+    if (value < 4)
+        return static_cast<int>(value);
+    const int high_bit = 63 - qCountLeadingZeroBits(value);
+    const int index = (high_bit - 1) * 4 + static_cast<int>((value >> (high_bit - 2)) & 3);
+    return qMin(index, m_buckets - 1);
+}
+
+double Latency::bucketUpperBound(int bucket)
+{
+    if (bucket < 4)
+        return bucket / 1000.;
+    const int high_bit = bucket / 4 + 1;
+    const quint64 upper = (static_cast<quint64>(5 + bucket % 4) << (high_bit - 2)) - 1;
+    return (upper - 1) / 1000.;
+}
+
+QString Latency::report()
+{
+    static const char *stage_names[StagesCount] = {
+        "frame completed", "pitch decided", "position updated", "played notes set", "frame swapped"
+    };
+
+    QMutexLocker locker(&m_registry_mutex);
+    QString text = "Latency since audio buffer arrival, in ms:";
+    for (int stage = 0; stage < StagesCount; stage++) {
+        QVector<quint64> counts(m_buckets, 0);
+        quint64 total = 0;
+        for (auto histograms : m_registry) {
+            for (int i = 0; i < m_buckets; i++)
+                counts[i] += histograms->counts[stage][i].load(std::memory_order_relaxed);
+        }
+        for (auto count : counts)
+            total += count;
+
+        text += QString("\n  %1: ").arg(stage_names[stage], -16);
+        if (total == 0) {
+            text += "no samples";
+            continue;
+        }
+
+        auto percentile = [&](double fraction) {
+            const quint64 rank = qMax<quint64>(1, static_cast<quint64>(fraction * total + 0.5));
+            quint64 seen = 0;
+            for (int i = 0; i < m_buckets; i++) {
+                seen += counts[i];
+                if (seen >= rank)
+                    return bucketUpperBound(i);
+            }
+            return bucketUpperBound(m_buckets - 1);
+        };
+        text += QString("p50 %1, p95 %2, p99 %3 (%4 samples)")
+                .arg(percentile(0.5), 0, 'f', 2).arg(percentile(0.95), 0, 'f', 2)
+                .arg(percentile(0.99), 0, 'f', 2).arg(total);
+    }
+    return text;
+}
@@ -1,27 +1,76 @@
 // Author:  Jakub Precht
 
 #include "lilypond.h"
+#include "lilypondserver.h"
+#include "metrics.h"
 #include "settings.h"
+#include "trace.h"
 
 #include <QProcess>
 #include <QDebug>
 #include <QDir>
 #include <QImage>
+#include <QPainter>
+#include <QSvgRenderer>
 
-Lilypond::Lilypond(QObject *parent) : QObject(parent) { }
+Lilypond::Lilypond(QObject *parent)
+    : QObject(parent), m_requests_timer(this)
+{
+    m_requests_timer.setSingleShot(true);
+    m_requests_timer.setInterval(m_coalesce_interval);
+    connect(&m_requests_timer, &QTimer::timeout, this, &Lilypond::generateScore);
+}
+
+void Lilypond::setScore(const ScorePointer &score)
+{
+    m_score = score;
+}
+
+void Lilypond::setSettingsSource(const SettingsSource *source)
+{
+    m_settings_source = source;
+}
 
-void Lilypond::setScore(const QVector<int> &score_notes)
+void Lilypond::startServers()
 {
-    m_score_notes = score_notes;
+    m_settings = m_settings_source->snapshot();
+    if (m_settings->lilypondServers() <= 0)
+        return;
+
+    // small score rendered by each server right after start, so fonts are already loaded for real score
+    const QString warmup_path = m_settings->lilypondWorkingDirectory() + "warmup/";
+    QDir().mkpath(warmup_path);
+    QFile warmup_file(warmup_path + "warmup.ly");
+    if (warmup_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        QTextStream stream(&warmup_file);
+        stream << m_settings->lilypondHeader() << "c'1 d' e' f' " << m_settings->lilypondFooter();
+        warmup_file.close();
+    } else {
+        qDebug() << "Failed to open: " << warmup_file.fileName();
+    }
+
+    for (int i = 0; i < m_settings->lilypondServers(); i++) {
+        auto server = new LilypondServer(warmup_file.fileName(), this);
+        connect(server, &LilypondServer::finishedRendering, this, &Lilypond::finishRendering);
+        m_servers.push_back(server);
+        server->start();
+    }
 }
 
-void Lilypond::setSettings(const Settings *settings)
+void Lilypond::requestScore(int generation)
 {
-    m_settings = settings;
+    // burst of requests ends up as one render of the newest one
+    m_requested_generation = generation;
+    m_requests_timer.start();
 }
 
 void Lilypond::generateScore()
 {
+    // outdated render would only waste cpu and write to the same directory
+    cancelRendering();
+    m_rendering_generation = m_requested_generation;
+    m_settings = m_settings_source->snapshot(); // whole render uses the same settings
+
     // create directory
     const QString directory_path = m_settings->lilypondWorkingDirectory();
     if (!QDir(directory_path).exists())
@@ -37,6 +86,7 @@ void Lilypond::generateScore()
     QFile lilypond_file(directory_path + "score.ly");
     if (!lilypond_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
         qDebug() << "Failed to open: " << directory_path + "score.ly";
+        m_rendering_generation = 0;
         return;
     }
 
@@ -46,15 +96,15 @@ void Lilypond::generateScore()
     const int notes_per_staff = m_settings->notesPerStaff();
     //  bool is_bass_clef = false;
     auto &notation = m_settings->lilypondNotesNotation();
-    for (; index < m_score_notes.size(); index++) {
+    for (; index < m_score->size(); index++) {
         if (index % notes_per_staff == 0 && index > 0) {
             stream << "\\break\n";
         }
         //    // switch bass and tremble clef
         //    if (index % m_settings->notesPerStaff() == 0) {
         //      bool is_low_note = false;
-        //      for (int j = 0; j < notes_per_staff && index + j < m_score_notes.size(); j++)
-        //        if (m_score_notes[index + j] < 48)
+        //      for (int j = 0; j < notes_per_staff && index + j < m_score->size(); j++)
+        //        if (m_score->pitch(index + j) < 48)
         //          is_low_note = true;
         //      if (is_low_note && !is_bass_clef) {
         //        stream << "\\clef bass ";
@@ -64,7 +114,7 @@ void Lilypond::generateScore()
         //        is_bass_clef = false;
         //      }
         //    }
-        stream << notation[m_score_notes[index]];
+        stream << notation[m_score->pitch(index)];
         if (index == 0) // set length of first note (rest will follow)
             stream << 1;
         stream << ' ';
@@ -79,77 +129,187 @@ void Lilypond::generateScore()
     stream.flush();
     lilypond_file.close();
 
-    m_process = new QProcess();
-    QStringList config;
-    config << "--png";
-    config << "-dresolution=" + QString::number(m_settings->dpi());
-    config << "-o" << directory_path + "score";
-    config << directory_path + "score.ly";
-
-    connect(m_process, qOverload<int>(&QProcess::finished), m_process, &QProcess::deleteLater);
-    connect(m_process, qOverload<int, QProcess::ExitStatus>(&QProcess::finished), this, &Lilypond::finish);
+    m_render_begin = Latency::now();
+    m_active_server = readyServer();
+    if (m_active_server != nullptr)
+        m_active_server->render(directory_path + "score.ly", m_settings->dpi(), m_settings->vectorScore());
+    else
+        startProcess(directory_path);
+}
 
+void Lilypond::startProcess(const QString &directory_path)
+{
     QFileInfo check_lilypond("/usr/bin/lilypond");
     if (!check_lilypond.exists()) {
         qCritical() << "No file \"/usr/bin/lilypond\". Lilypond may be not installed.";
+        m_rendering_generation = 0;
         return;
     }
 
+    QStringList config;
+    if (m_settings->vectorScore()) {
+        config << "-dbackend=svg";
+    } else {
+        config << "--png";
+        config << "-dresolution=" + QString::number(m_settings->dpi());
+    }
+    config << "-o" << directory_path + "score";
+    config << directory_path + "score.ly";
+
+    QProcess *process = new QProcess(this);
+    connect(process, qOverload<int, QProcess::ExitStatus>(&QProcess::finished),
+            this, [=](int exit_code, QProcess::ExitStatus exit_status){
+        process->deleteLater();
+        if (process != m_process) // cancelled
+            return;
+        m_process = nullptr;
+        bool success = exit_code == 0 && exit_status == QProcess::NormalExit;
+        finishRendering(success, QString::fromUtf8(process->readAllStandardError()));
+    });
+
+    m_process = process;
     m_process->start("/usr/bin/lilypond", config);
 }
 
-void Lilypond::finish(int exit_code, QProcess::ExitStatus exit_status)
+void Lilypond::cancelRendering()
+{
+    if (m_rendering_generation == 0)
+        return;
+
+    if (m_process != nullptr) {
+        QProcess *process = m_process;
+        m_process = nullptr;
+        process->kill();
+        process->waitForFinished(1000); // make sure it won't write to working directory anymore
+    }
+    if (m_active_server != nullptr) {
+        m_active_server->cancel();
+        m_active_server = nullptr;
+    }
+    m_rendering_generation = 0;
+}
+
+LilypondServer *Lilypond::readyServer() const
+{
+    for (auto server : m_servers)
+        if (server->isReady())
+            return server;
+    return nullptr;
+}
+
+void Lilypond::finishRendering(bool success, const QString &errors)
 {
-    if (exit_code != 0 || exit_status != QProcess::NormalExit) {
+    const int generation = m_rendering_generation;
+    m_rendering_generation = 0;
+    m_active_server = nullptr;
+    if (generation != 0 && Trace::isEnabled())
+        Trace::complete("lilypond", m_render_begin, Latency::now());
+    if (generation == 0 || generation != m_requested_generation)
+        return; // newer request is already waiting, no point in loading pages
+
+    if (!success) {
         qWarning() << "lilypond error:";
-        qWarning().nospace() << QString::fromStdString(m_process->readAllStandardError().toStdString());
+        qWarning().nospace().noquote() << errors;
     }
-    auto pages = countPages();
-    auto ys = calculateIndicatorYs(pages);
-    emit finishedGeneratingScore(pages, ys);
+    RenderedScore score;
+    score.generation = generation;
+    if (m_settings->vectorScore())
+        loadVectorPages(score, countPages());
+    else
+        loadPages(score, countPages());
+    Metrics::add(Metrics::Renders);
+    Metrics::add(Metrics::RenderMicroseconds, static_cast<quint64>((Latency::now() - m_render_begin) / 1000));
+    emit finishedGeneratingScore(score);
 }
 
 int Lilypond::countPages() const
 {
-    QDir dir(m_settings->lilypondWorkingDirectory());
-    dir.setNameFilters(QStringList() << "*.png");
-    dir.setFilter(QDir::Files);
-    return (dir.entryList().size() - 1);
+    // backends differ in other files they leave, so pages are counted by their names; old ones are deleted
+    int pages_number = 0;
+    while (QFileInfo::exists(pageFileName(pages_number + 1)))
+        pages_number++;
+    return pages_number;
 }
 
-QVector<QVector<int>> Lilypond::calculateIndicatorYs(int pages_number) const
+QString Lilypond::pageFileName(int page) const
+{
+    const QString extension = m_settings->vectorScore() ? ".svg" : ".png";
+    const QString prefix = m_settings->lilypondWorkingDirectory() + "score-";
+    // svg backend of some lilypond versions names pages without "page", score of one page has no number
+    QString file_name = prefix + "page" + QString::number(page) + extension;
+    if (!QFileInfo::exists(file_name) && QFileInfo::exists(prefix + QString::number(page) + extension))
+        file_name = prefix + QString::number(page) + extension;
+    const QString single_page = m_settings->lilypondWorkingDirectory() + "score" + extension;
+    if (page == 1 && !QFileInfo::exists(file_name) && QFileInfo::exists(single_page))
+        file_name = single_page;
+    return file_name;
+}
+
+void Lilypond::loadPages(RenderedScore &score, int pages_number) const
 {
-    QVector<QVector<int>> indicator_ys;
     for (int i = 1; i <= pages_number; i++) {
-        QString page_file_name = m_settings->lilypondWorkingDirectory() + "score-page" + QString::number(i) + ".png";
+        QString page_file_name = pageFileName(i);
         QFileInfo check_file(page_file_name);
         if (!check_file.exists() || !check_file.isFile()) {
             qWarning() << "Score file does not exists: " << page_file_name;
             break;
         }
 
-        indicator_ys.push_back({}); // new page
-
-        QImage image(page_file_name);
-        bool last_was_white = true;
-        int counter = 0;
-        for (int y = image.height(); y >= 0; y--) {
-            QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
-            QColor color(line[m_settings->staffIndent()]);
-
-            if(color == Qt::white) {
-                last_was_white = true;
-            } else {
-                if (!last_was_white)
-                    continue;
-                last_was_white = false;
-                if (++counter == 5)
-                    indicator_ys.back().push_back(y);
-                counter %= 5;
-            }
+        // decode here, in lilypond thread, and convert to opaque format that scene graph uploads as is
+        QImage image = QImage(page_file_name).convertToFormat(QImage::Format_RGB32);
+        score.page_size = image.size();
+        score.indicator_ys.push_back(calculateIndicatorYs(image));
+        score.pages.push_back(image);
+    }
+}
+
+void Lilypond::loadVectorPages(RenderedScore &score, int pages_number) const
+{
+    for (int i = 1; i <= pages_number; i++) {
+        QFile page_file(pageFileName(i));
+        if (!page_file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Score file does not exists: " << page_file.fileName();
+            break;
+        }
+        QByteArray document = page_file.readAll();
+        page_file.close();
+
+        // svg units are converted with 90 dpi, staff positions are searched on bitmap with settings dpi
+        QSvgRenderer renderer(document);
+        score.page_size = renderer.defaultSize() * m_settings->dpi() / 90.0;
+        QImage image(score.page_size, QImage::Format_RGB32);
+        image.fill(Qt::white);
+        QPainter painter(&image);
+        renderer.render(&painter);
+        painter.end();
+
+        score.indicator_ys.push_back(calculateIndicatorYs(image));
+        score.vector_pages.push_back(document);
+    }
+}
+
+QVector<int> Lilypond::calculateIndicatorYs(const QImage &page) const
+{
+    TRACE_SCOPE("staff detection");
+    QVector<int> indicator_ys;
+    bool last_was_white = true;
+    int counter = 0;
+    for (int y = page.height() - 1; y >= 0; y--) {
+        const QRgb *line = reinterpret_cast<const QRgb *>(page.constScanLine(y));
+        QColor color(line[m_settings->staffIndent()]);
+
+        if(color == Qt::white) {
+            last_was_white = true;
+        } else {
+            if (!last_was_white)
+                continue;
+            last_was_white = false;
+            if (++counter == 5)
+                indicator_ys.push_back(y);
+            counter %= 5;
         }
-        std::sort(indicator_ys.back().begin(), indicator_ys.back().end());
     }
+    std::sort(indicator_ys.begin(), indicator_ys.end());
 
     return indicator_ys;
 }
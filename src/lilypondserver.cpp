@@ -0,0 +1,141 @@
+// Author:  Jakub Precht
+
+#include "lilypondserver.h"
+
+#include <QDebug>
+#include <QFileInfo>
+#include <QTimer>
+
+const QByteArray LilypondServer::m_ready_marker = "@score-follower-ready@";
+const QByteArray LilypondServer::m_done_marker = "@score-follower-done@";
+const QByteArray LilypondServer::m_failed_marker = "@score-follower-failed@";
+
+LilypondServer::LilypondServer(const QString &warmup_file, QObject *parent)
+    : QObject(parent), m_warmup_file(warmup_file)
+{ }
+
+void LilypondServer::start()
+{
+    if (m_state != State::Stopped || m_failed_starts >= m_max_failed_starts)
+        return;
+
+    if (m_process == nullptr) {
+        m_process = new QProcess(this);
+        connect(m_process, &QProcess::readyReadStandardOutput, this, &LilypondServer::readOutput);
+        connect(m_process, qOverload<int, QProcess::ExitStatus>(&QProcess::finished),
+                this, &LilypondServer::processFinished);
+        connect(m_process, &QProcess::errorOccurred, this, [=](QProcess::ProcessError error){
+            if (error == QProcess::FailedToStart)
+                processFinished(-1, QProcess::CrashExit);
+        });
+    }
+
+    m_state = State::Starting;
+    m_output.clear();
+    // scheme-sandbox.ly from lilypond's init files drops into guile REPL reading from stdin
+    m_process->start("/usr/bin/lilypond", QStringList() << "--png" << "scheme-sandbox");
+    // backend chosen by "--png" is remembered, so png renders can switch back to it after svg ones
+    m_process->write("(define score-follower-png-backend (ly:get-option 'backend)) "
+                     "(display \"\\n" + m_ready_marker + "\\n\") (force-output)\n");
+}
+
+bool LilypondServer::isReady() const
+{
+    return m_state == State::Ready;
+}
+
+void LilypondServer::render(const QString &file_name, int dpi, bool vector)
+{
+    if (m_state != State::Ready) {
+        qWarning() << "Lilypond server is not ready to render.";
+        emit finishedRendering(false, "");
+        return;
+    }
+
+    m_state = State::Rendering;
+    m_process->readAllStandardError(); // drop messages of previous render
+    sendRenderCommand(file_name, dpi, vector);
+}
+
+void LilypondServer::cancel()
+{
+    if (m_state != State::Rendering)
+        return;
+
+    // there is no way to interrupt guile in the middle of a score, so instance is restarted
+    m_state = State::Cancelling;
+    m_process->kill();
+    m_process->waitForFinished(1000);
+}
+
+void LilypondServer::sendRenderCommand(const QString &file_name, int dpi, bool vector)
+{
+    // output files are named after input file and written to current directory, same as with "-o"
+    QFileInfo info(file_name);
+    QString command = QString("(catch #t (lambda () "
+                              "(ly:set-option 'resolution %1) "
+                              "(ly:set-option 'backend %6) "
+                              "(chdir %2) "
+                              "(ly:parse-file %3) "
+                              "(display \"\\n%4\\n\")) "
+                              "(lambda (key . args) (display \"\\n%5\\n\"))) "
+                              "(force-output)\n")
+            .arg(dpi)
+            .arg(schemeString(info.absolutePath()))
+            .arg(schemeString(info.fileName()))
+            .arg(QString(m_done_marker))
+            .arg(QString(m_failed_marker))
+            .arg(vector ? "'svg" : "score-follower-png-backend");
+    m_process->write(command.toUtf8());
+}
+
+void LilypondServer::readOutput()
+{
+    m_output += m_process->readAllStandardOutput();
+
+    bool done = m_output.contains(m_done_marker);
+    bool failed = m_output.contains(m_failed_marker);
+    if (m_state == State::Starting && m_output.contains(m_ready_marker)) {
+        m_output.clear();
+        m_failed_starts = 0;
+        if (m_warmup_file.isEmpty()) {
+            m_state = State::Ready;
+        } else {
+            m_state = State::WarmingUp; // first render loads fonts, do it before user waits for it
+            sendRenderCommand(m_warmup_file, 10, false);
+        }
+    } else if (done || failed) {
+        m_output.clear();
+        if (m_state == State::WarmingUp) {
+            m_state = State::Ready;
+        } else if (m_state == State::Rendering) {
+            m_state = State::Ready;
+            emit finishedRendering(done, QString::fromUtf8(m_process->readAllStandardError()));
+        }
+    }
+}
+
+void LilypondServer::processFinished(int exit_code, QProcess::ExitStatus exit_status)
+{
+    Q_UNUSED(exit_code);
+    Q_UNUSED(exit_status);
+
+    State state = m_state;
+    m_state = State::Stopped;
+    if (state == State::Starting)
+        m_failed_starts++;
+    if (m_failed_starts == m_max_failed_starts)
+        qWarning() << "Failed to start lilypond server. Scores will be rendered by new lilypond processes.";
+
+    if (state == State::Rendering)
+        emit finishedRendering(false, QString::fromUtf8(m_process->readAllStandardError()));
+
+    QTimer::singleShot(0, this, &LilypondServer::start); // not from inside of finished signal
+}
+
+QString LilypondServer::schemeString(const QString &text)
+{
+    QString escaped = text;
+    escaped.replace('\\', "\\\\").replace('"', "\\\"");
+    return '"' + escaped + '"';
+}
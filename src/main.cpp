@@ -6,17 +6,93 @@
 #include <QDebug>
 #include <QQuickStyle>
 #include <QApplication>
+#include <QQuickWindow>
 
+#include "audiolog.h"
+#include "calibrator.h"
 #include "controller.h"
+#include "followerserver.h"
+#include "indicatorlayer.h"
+#include "latency.h"
 #include "recorder.h"
+#include "scorefile.h"
+#include "scorereader.h"
+#include "trace.h"
 
 #include <cstring>
 
+// reads score in any supported format and stores it precompiled
+static int convertScore(int argc, char *argv[], const QString &input, const QString &output)
+{
+  QCoreApplication app(argc, argv);
+  ScorePointer score = ScoreReader::readScoreFile(input);
+  if (score->isEmpty()) {
+    qCritical().nospace() << "No notes read from " << input << ".";
+    return -1;
+  }
+  return ScoreFile::write(*score, output) ? 0 : -1;
+}
+
+// replays recording through pitch detector and stores per note confidence in settings
+static int calibrate(int argc, char *argv[], const QString &recording, const QString &annotations)
+{
+  QCoreApplication app(argc, argv);
+  auto settings = std::make_shared<Settings>();
+  if (!settings->readSettings())
+    return -1;
+  Calibrator calibrator(settings);
+  return calibrator.calibrate(recording, annotations) ? 0 : -1;
+}
+
+// follows sessions listed in a json file without gui, until killed
+static int serve(int argc, char *argv[], const QString &sessions)
+{
+  QCoreApplication app(argc, argv);
+  AudioLog::start();
+  FollowerServer server;
+  const int result = server.start(sessions) ? app.exec() : -1;
+  AudioLog::stop();
+  return result;
+}
+
 int main(int argc, char *argv[])
 {
   bool is_verbose = false;
+  bool print_latency = false;
+  QString trace_filename;
   for (int i = 1; i < argc; i++) {
-    if (std::strcmp(argv[i], "-v") && std::strcmp(argv[i], "--verbose"))
+    if (!std::strcmp(argv[i], "--convert")) {
+      if (i + 2 >= argc) {
+        qCritical() << "Usage: --convert <score> <output.sfs>";
+        return -1;
+      }
+      return convertScore(argc, argv, argv[i + 1], argv[i + 2]);
+    }
+    if (!std::strcmp(argv[i], "--calibrate")) {
+      if (i + 1 >= argc) {
+        qCritical() << "Usage: --calibrate <recording> [<annotations>]";
+        return -1;
+      }
+      return calibrate(argc, argv, argv[i + 1], i + 2 < argc ? argv[i + 2] : "");
+    }
+    if (!std::strcmp(argv[i], "--server")) {
+      if (i + 1 >= argc) {
+        qCritical() << "Usage: --server <sessions.json>";
+        return -1;
+      }
+      return serve(argc, argv, argv[i + 1]);
+    }
+    if (!std::strcmp(argv[i], "--trace")) {
+      if (i + 1 >= argc) {
+        qCritical() << "Usage: --trace <output.json>";
+        return -1;
+      }
+      trace_filename = argv[++i];
+      continue;
+    }
+    if (!std::strcmp(argv[i], "--latency"))
+      print_latency = true;
+    else if (std::strcmp(argv[i], "-v") && std::strcmp(argv[i], "--verbose"))
       qWarning().nospace() << "Unrecognized argument: " << QString(argv[i]) <<".";
     else
       is_verbose = true;
@@ -28,18 +104,31 @@ int main(int argc, char *argv[])
 
   QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
   QApplication app(argc, argv);
+  qmlRegisterType<IndicatorLayer>("ScoreFollower", 1, 0, "IndicatorLayer");
   QQmlApplicationEngine engine;
 
+  AudioLog::start();
+  // timeline of the whole run, written when application quits
+  if (!trace_filename.isEmpty())
+    Trace::start();
   Controller controller(is_verbose);
   if (!controller.createdSuccessfully()) {
     qCritical() << "Aborting...";
     return -1;
   }
   engine.rootContext()->setContextProperty("controller", &controller);
+  engine.addImageProvider("score", controller.imageProvider());
 
   engine.load(QUrl(QStringLiteral("qrc:/qml/main.qml")));
   if (engine.rootObjects().isEmpty())
     return -1;
+  controller.attachWindow(qobject_cast<QQuickWindow *>(engine.rootObjects().first()));
 
-  return app.exec();
+  const int result = app.exec();
+  AudioLog::stop();
+  if (print_latency)
+    qInfo().noquote() << Latency::report();
+  if (!trace_filename.isEmpty())
+    Trace::stop(trace_filename);
+  return result;
 }
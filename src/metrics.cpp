@@ -0,0 +1,44 @@
+// Author:  Jakub Precht
+
+#include "metrics.h"
+
+#include <QString>
+
+std::atomic<quint64> Metrics::m_counters[CountersCount];
+std::atomic<double> Metrics::m_gauges[GaugesCount];
+
+QByteArray Metrics::exposition()
+{
+    auto counter = [](Counter index) {
+        return m_counters[index].load(std::memory_order_relaxed);
+    };
+
+    QByteArray text;
+    auto add = [&](const char *name, const char *type, const char *help, const QString &value) {
+        text += QString("# HELP score_follower_%1 %2\n# TYPE score_follower_%1 %3\n").arg(name, help, type).toUtf8();
+        text += QString("score_follower_%1 %2\n").arg(name, value).toUtf8();
+    };
+    add("frames_processed_total", "counter", "Audio frames pitch was detected in.",
+        QString::number(counter(FramesProcessed)));
+    add("frames_low_confidence_total", "counter", "Frames with new note ignored for low confidence.",
+        QString::number(counter(FramesLowConfidence)));
+    add("notes_detected_total", "counter", "Detected note changes, rate of it gives detections per second.",
+        QString::number(counter(NotesDetected)));
+    add("buffers_received_total", "counter", "Audio buffers delivered by audio input.",
+        QString::number(counter(BuffersReceived)));
+    add("buffers_processed_total", "counter", "Audio buffers processed by recorder.",
+        QString::number(counter(BuffersProcessed)));
+    add("buffers_dropped_total", "counter", "Audio buffers missing from the stream.",
+        QString::number(counter(BuffersDropped)));
+    add("audio_queue_depth", "gauge", "Audio buffers waiting for recorder.",
+        QString::number(qMax<qint64>(0, static_cast<qint64>(counter(BuffersReceived) - counter(BuffersProcessed)))));
+    add("dtw_cost_per_note", "gauge", "Cost of current alignment divided by number of aligned notes.",
+        QString::number(m_gauges[DtwCostPerNote].load(std::memory_order_relaxed)));
+
+    // summary without quantiles, average render time is sum divided by count
+    text += "# HELP score_follower_render_seconds Time of rendering score with lilypond.\n"
+            "# TYPE score_follower_render_seconds summary\n";
+    text += QString("score_follower_render_seconds_sum %1\n").arg(counter(RenderMicroseconds) / 1e6).toUtf8();
+    text += QString("score_follower_render_seconds_count %1\n").arg(counter(Renders)).toUtf8();
+    return text;
+}
@@ -0,0 +1,68 @@
+// Author:  Jakub Precht
+
+#include "metricsserver.h"
+#include "metrics.h"
+
+#include <QDebug>
+#include <QTcpSocket>
+
+MetricsServer::MetricsServer(QObject *parent)
+    : QObject(parent), m_server(this)
+{
+    connect(&m_server, &QTcpServer::newConnection, this, &MetricsServer::acceptConnection);
+}
+
+bool MetricsServer::listen(int port)
+{
+    if (m_server.isListening() && m_server.serverPort() == port)
+        return true;
+
+    m_server.close();
+    if (port == 0)
+        return true;
+    // only local, counters tell what is being played
+    if (!m_server.listen(QHostAddress::LocalHost, static_cast<quint16>(port))) {
+        qWarning().nospace() << "Failed to serve metrics on port " << port << ": " << m_server.errorString();
+        return false;
+    }
+    qInfo().nospace() << "Serving metrics at http://localhost:" << port << "/metrics.";
+    return true;
+}
+
+void MetricsServer::acceptConnection()
+{
+    while (m_server.hasPendingConnections()) {
+        QTcpSocket *socket = m_server.nextPendingConnection();
+        connect(socket, &QTcpSocket::disconnected, this, [=]{
+            m_requests.remove(socket);
+            socket->deleteLater();
+        });
+        connect(socket, &QTcpSocket::readyRead, this, [=]{
+            respond(socket);
+        });
+    }
+}
+
+void MetricsServer::respond(QTcpSocket *socket)
+{
+    // wait for whole request head, body of GET is empty
+    QByteArray &request = m_requests[socket];
+    request += socket->readAll();
+    if (!request.contains("\r\n\r\n") && request.size() < m_max_request_size)
+        return;
+
+    const QList<QByteArray> request_line = request.left(request.indexOf("\r\n")).split(' ');
+    const bool is_metrics = request_line.value(0) == "GET"
+            && (request_line.value(1) == "/metrics" || request_line.value(1) == "/");
+    m_requests.remove(socket);
+    disconnect(socket, &QTcpSocket::readyRead, this, nullptr);
+    const QByteArray body = is_metrics ? Metrics::exposition() : QByteArray("Not found, see /metrics.\n");
+
+    QByteArray response = is_metrics ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 404 Not Found\r\n";
+    response += is_metrics ? "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           : "Content-Type: text/plain; charset=utf-8\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n\r\n";
+    socket->write(response + body);
+    socket->disconnectFromHost();
+}
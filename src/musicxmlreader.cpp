@@ -0,0 +1,487 @@
+// Author:  Jakub Precht
+
+#include "musicxmlreader.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QScopedPointer>
+#include <QtEndian>
+#include <QDebug>
+
+#include <zlib.h>
+
+const int MusicXmlReader::m_default_velocity;
+constexpr double MusicXmlReader::m_forte_velocity;
+
+namespace {
+
+// .mxl files are zip archives with the score and META-INF/container.xml pointing at it
+struct ZipEntry
+{
+    QString name;
+    quint16 method;
+    qint64 compressed_size;
+    qint64 local_header_offset;
+};
+
+const quint32 m_zip_end_signature = 0x06054b50;
+const quint32 m_zip_entry_signature = 0x02014b50;
+const quint32 m_zip_local_signature = 0x04034b50;
+const int m_zip_end_size = 22;
+const int m_zip_entry_size = 46;
+const int m_zip_local_size = 30;
+const quint16 m_zip_stored = 0;
+const quint16 m_zip_deflated = 8;
+
+quint16 readLe16(const QByteArray &data, int offset)
+{
+    return qFromLittleEndian<quint16>(reinterpret_cast<const uchar *>(data.constData() + offset));
+}
+
+quint32 readLe32(const QByteArray &data, int offset)
+{
+    return qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(data.constData() + offset));
+}
+
+QVector<ZipEntry> readZipDirectory(QIODevice *archive)
+{
+    // end of central directory record is followed only by comment of at most 64 KiB
+    const qint64 tail_size = qMin<qint64>(archive->size(), 0xffff + m_zip_end_size);
+    archive->seek(archive->size() - tail_size);
+    const QByteArray tail = archive->read(tail_size);
+    int end = tail.size() - m_zip_end_size;
+    while (end >= 0 && readLe32(tail, end) != m_zip_end_signature)
+        end--;
+    if (end < 0)
+        return {};
+
+    const qint64 directory_size = readLe32(tail, end + 12);
+    const qint64 directory_offset = readLe32(tail, end + 16);
+    archive->seek(directory_offset);
+    const QByteArray directory = archive->read(directory_size);
+
+    QVector<ZipEntry> entries;
+    int position = 0;
+    while (position + m_zip_entry_size <= directory.size() && readLe32(directory, position) == m_zip_entry_signature) {
+        const int name_length = readLe16(directory, position + 28);
+        const int extra_length = readLe16(directory, position + 30);
+        const int comment_length = readLe16(directory, position + 32);
+        ZipEntry entry;
+        entry.name = QString::fromUtf8(directory.mid(position + m_zip_entry_size, name_length));
+        entry.method = readLe16(directory, position + 10);
+        entry.compressed_size = readLe32(directory, position + 20);
+        entry.local_header_offset = readLe32(directory, position + 42);
+        entries.push_back(entry);
+        position += m_zip_entry_size + name_length + extra_length + comment_length;
+    }
+    return entries;
+}
+
+// Inflates one entry of a zip archive on demand, holding only one chunk of compressed data at a time.
+class ZipEntryDevice : public QIODevice
+{
+public:
+    ZipEntryDevice(QIODevice *archive, const ZipEntry &entry)
+        : m_archive(archive), m_method(entry.method), m_input_left(entry.compressed_size)
+    {
+        if (m_method != m_zip_stored && m_method != m_zip_deflated) {
+            qWarning() << "Unsupported compression method of " << entry.name;
+            return;
+        }
+
+        // data follows local header, whose extra field may differ from the one in the directory
+        m_archive->seek(entry.local_header_offset);
+        const QByteArray header = m_archive->read(m_zip_local_size);
+        if (header.size() != m_zip_local_size || readLe32(header, 0) != m_zip_local_signature)
+            return;
+        m_archive->seek(entry.local_header_offset + m_zip_local_size + readLe16(header, 26) + readLe16(header, 28));
+
+        if (m_method == m_zip_deflated) {
+            m_stream.zalloc = Z_NULL;
+            m_stream.zfree = Z_NULL;
+            m_stream.opaque = Z_NULL;
+            m_stream.next_in = Z_NULL;
+            m_stream.avail_in = 0;
+            if (inflateInit2(&m_stream, -MAX_WBITS) != Z_OK) // raw deflate, no zlib header
+                return;
+            m_inflating = true;
+        }
+        open(QIODevice::ReadOnly);
+    }
+
+    ~ZipEntryDevice() override
+    {
+        if (m_inflating)
+            inflateEnd(&m_stream);
+    }
+
+    bool isSequential() const override
+    {
+        return true;
+    }
+
+protected:
+    qint64 readData(char *data, qint64 max_size) override
+    {
+        if (m_method == m_zip_stored) {
+            const qint64 read = m_archive->read(data, qMin(max_size, m_input_left));
+            if (read <= 0)
+                return -1;
+            m_input_left -= read;
+            return read;
+        }
+
+        const uInt output_size = static_cast<uInt>(qMin<qint64>(max_size, m_chunk_size));
+        m_stream.next_out = reinterpret_cast<Bytef *>(data);
+        m_stream.avail_out = output_size;
+        while (m_stream.avail_out > 0 && !m_stream_end) {
+            if (m_stream.avail_in == 0) {
+                m_input = m_archive->read(qMin<qint64>(m_input_left, m_chunk_size));
+                if (m_input.isEmpty())
+                    break; // truncated archive
+                m_input_left -= m_input.size();
+                m_stream.next_in = reinterpret_cast<Bytef *>(m_input.data());
+                m_stream.avail_in = static_cast<uInt>(m_input.size());
+            }
+
+            const int result = inflate(&m_stream, Z_NO_FLUSH);
+            if (result == Z_STREAM_END) {
+                m_stream_end = true;
+            } else if (result != Z_OK) {
+                setErrorString("Corrupted compressed score");
+                return -1;
+            }
+        }
+
+        const qint64 produced = output_size - m_stream.avail_out;
+        return produced > 0 ? produced : -1;
+    }
+
+    qint64 writeData(const char *data, qint64 size) override
+    {
+        Q_UNUSED(data);
+        Q_UNUSED(size);
+        return -1;
+    }
+
+private:
+    QIODevice *m_archive;
+    quint16 m_method;
+    qint64 m_input_left; // compressed bytes not read from archive yet
+    QByteArray m_input;
+    z_stream m_stream;
+    bool m_inflating = false;
+    bool m_stream_end = false;
+
+    static const qint64 m_chunk_size = 64 * 1024;
+};
+
+const qint64 ZipEntryDevice::m_chunk_size;
+
+} // namespace
+
+ScorePointer MusicXmlReader::readFile(const QString &filename, const ProgressCallback &progress)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Failed to open: " << filename;
+        return ScorePointer::create();
+    }
+
+    if (QFileInfo(filename).suffix() == "mxl") {
+        QScopedPointer<QIODevice> score_file(openCompressedScore(&file));
+        if (score_file.isNull()) {
+            qWarning() << "No score found in compressed MusicXML: " << filename;
+            return ScorePointer::create();
+        }
+        // entry is inflated chunk by chunk as parser needs it, so position in archive follows parsing
+        return read(score_file.data(), &file, progress);
+    }
+    return read(&file, &file, progress);
+}
+
+ScorePointer MusicXmlReader::read(QIODevice *device, const ProgressCallback &progress)
+{
+    return read(device, device, progress);
+}
+
+ScorePointer MusicXmlReader::read(QIODevice *device, QIODevice *file, const ProgressCallback &progress)
+{
+    MusicXmlReader reader(device, file, progress);
+    if (!reader.readScore()) {
+        qWarning().nospace() << "Failed reading MusicXML score at line " << reader.m_xml.lineNumber() << ": "
+                             << reader.m_xml.errorString();
+        return ScorePointer::create();
+    }
+    reader.m_score->finish();
+    return reader.m_score;
+}
+
+MusicXmlReader::MusicXmlReader(QIODevice *device, QIODevice *file, const ProgressCallback &progress)
+    : m_xml(device), m_score(QSharedPointer<ScoreModel>::create()), m_file(file), m_progress(progress)
+{ }
+
+QIODevice *MusicXmlReader::openCompressedScore(QIODevice *archive)
+{
+    const QVector<ZipEntry> entries = readZipDirectory(archive);
+    auto find_entry = [&](const QString &name) -> const ZipEntry * {
+        for (auto &entry : entries) {
+            if (entry.name == name)
+                return &entry;
+        }
+        return nullptr;
+    };
+
+    // root file named by container, otherwise first MusicXML file outside of META-INF
+    const ZipEntry *score_entry = nullptr;
+    if (const ZipEntry *container_entry = find_entry("META-INF/container.xml")) {
+        ZipEntryDevice container_file(archive, *container_entry);
+        QXmlStreamReader container(&container_file);
+        while (score_entry == nullptr && !container.atEnd()) {
+            if (container.readNext() == QXmlStreamReader::StartElement && container.name() == QLatin1String("rootfile"))
+                score_entry = find_entry(container.attributes().value("full-path").toString());
+        }
+    }
+    for (int i = 0; i < entries.size() && score_entry == nullptr; i++) {
+        const QString &name = entries[i].name;
+        if (!name.startsWith("META-INF/") && (name.endsWith(".xml") || name.endsWith(".musicxml")))
+            score_entry = &entries[i];
+    }
+    if (score_entry == nullptr)
+        return nullptr;
+
+    auto device = new ZipEntryDevice(archive, *score_entry);
+    if (!device->isOpen()) {
+        delete device;
+        return nullptr;
+    }
+    return device;
+}
+
+bool MusicXmlReader::readScore()
+{
+    if (m_xml.readNextStartElement()) {
+        if (m_xml.name() == QLatin1String("score-partwise")) {
+            while (m_xml.readNextStartElement()) {
+                if (m_xml.name() == QLatin1String("part"))
+                    readPart();
+                else
+                    m_xml.skipCurrentElement();
+            }
+        } else if (m_xml.name() == QLatin1String("score-timewise")) {
+            m_xml.raiseError("Timewise scores are not supported, convert them to partwise");
+        } else {
+            m_xml.raiseError("Not a MusicXML score");
+        }
+    }
+    return !m_xml.hasError();
+}
+
+void MusicXmlReader::readPart()
+{
+    m_divisions = 1;
+    m_velocity = m_default_velocity;
+    m_position = 0;
+    m_chord_onset = 0;
+    while (m_xml.readNextStartElement()) {
+        if (m_xml.name() == QLatin1String("measure"))
+            readMeasure();
+        else
+            m_xml.skipCurrentElement();
+    }
+    flushTiedNotes();
+    m_voice++;
+}
+
+void MusicXmlReader::readMeasure()
+{
+    // voices of a measure are written one after another with backup in between
+    reportProgress();
+    m_measure_end = m_position;
+    while (m_xml.readNextStartElement()) {
+        if (m_xml.name() == QLatin1String("note")) {
+            readNote();
+        } else if (m_xml.name() == QLatin1String("backup")) {
+            m_position = qMax<qint64>(m_position - readDuration(), 0);
+        } else if (m_xml.name() == QLatin1String("forward")) {
+            m_position += readDuration();
+            m_measure_end = qMax(m_measure_end, m_position);
+        } else if (m_xml.name() == QLatin1String("attributes")) {
+            readAttributes();
+        } else if (m_xml.name() == QLatin1String("direction")) {
+            readDirection();
+        } else if (m_xml.name() == QLatin1String("sound")) {
+            readSound();
+        } else {
+            m_xml.skipCurrentElement();
+        }
+    }
+    m_position = m_measure_end;
+}
+
+void MusicXmlReader::readAttributes()
+{
+    while (m_xml.readNextStartElement()) {
+        if (m_xml.name() == QLatin1String("divisions")) {
+            const double divisions = m_xml.readElementText().toDouble();
+            if (divisions > 0)
+                m_divisions = divisions;
+        } else {
+            m_xml.skipCurrentElement();
+        }
+    }
+}
+
+void MusicXmlReader::readNote()
+{
+    bool is_chord = false;
+    bool is_grace = false;
+    bool is_played = true;
+    bool tie_start = false;
+    bool tie_stop = false;
+    int pitch = -1;
+    qint64 duration = 0;
+
+    int velocity = m_velocity;
+    const QStringRef dynamics = m_xml.attributes().value("dynamics");
+    if (!dynamics.isEmpty())
+        velocity = qRound(dynamics.toDouble() * m_forte_velocity / 100);
+
+    while (m_xml.readNextStartElement()) {
+        if (m_xml.name() == QLatin1String("pitch")) {
+            pitch = readPitch();
+        } else if (m_xml.name() == QLatin1String("duration")) {
+            duration = toTicks(m_xml.readElementText());
+        } else if (m_xml.name() == QLatin1String("chord")) {
+            is_chord = true;
+            m_xml.skipCurrentElement();
+        } else if (m_xml.name() == QLatin1String("tie")) {
+            if (m_xml.attributes().value("type") == QLatin1String("start"))
+                tie_start = true;
+            else
+                tie_stop = true;
+            m_xml.skipCurrentElement();
+        } else if (m_xml.name() == QLatin1String("grace")) {
+            is_grace = true;
+            m_xml.skipCurrentElement();
+        } else if (m_xml.name() == QLatin1String("rest") || m_xml.name() == QLatin1String("unpitched")
+                   || m_xml.name() == QLatin1String("cue")) {
+            is_played = false;
+            m_xml.skipCurrentElement();
+        } else {
+            m_xml.skipCurrentElement();
+        }
+    }
+
+    // grace notes take no time in notation and are too short to be followed
+    if (is_grace)
+        return;
+
+    // chord notes start together with the previous note, which already moved position
+    if (!is_chord) {
+        m_chord_onset = m_position;
+        m_position += duration;
+        m_measure_end = qMax(m_measure_end, m_position);
+    }
+    if (!is_played || pitch < 0)
+        return;
+
+    Note note = { m_chord_onset, duration, pitch, velocity };
+    auto tied = m_tied_notes.find(pitch);
+    if (tie_stop && tied != m_tied_notes.end()) {
+        tied->duration = note.onset + note.duration - tied->onset;
+        note = *tied;
+        m_tied_notes.erase(tied);
+    } else if (tied != m_tied_notes.end()) {
+        addNote(*tied); // tie never closed
+        m_tied_notes.erase(tied);
+    }
+
+    if (tie_start)
+        m_tied_notes.insert(pitch, note);
+    else
+        addNote(note);
+}
+
+void MusicXmlReader::readDirection()
+{
+    while (m_xml.readNextStartElement()) {
+        if (m_xml.name() == QLatin1String("sound"))
+            readSound();
+        else
+            m_xml.skipCurrentElement();
+    }
+}
+
+void MusicXmlReader::readSound()
+{
+    const QXmlStreamAttributes attributes = m_xml.attributes();
+    const double tempo = attributes.value("tempo").toDouble(); // quarters per minute
+    if (tempo > 0)
+        m_score->addTempoChange(m_position, static_cast<qint32>(qRound(60e6 / tempo)));
+    const QStringRef dynamics = attributes.value("dynamics");
+    if (!dynamics.isEmpty())
+        m_velocity = qRound(dynamics.toDouble() * m_forte_velocity / 100);
+    m_xml.skipCurrentElement();
+}
+
+qint64 MusicXmlReader::readDuration()
+{
+    qint64 duration = 0;
+    while (m_xml.readNextStartElement()) {
+        if (m_xml.name() == QLatin1String("duration"))
+            duration = toTicks(m_xml.readElementText());
+        else
+            m_xml.skipCurrentElement();
+    }
+    return duration;
+}
+
+int MusicXmlReader::readPitch()
+{
+    static const int step_semitones[] = { 9, 11, 0, 2, 4, 5, 7 }; // from A to G
+    int step = -1;
+    double alter = 0;
+    int octave = 4;
+    while (m_xml.readNextStartElement()) {
+        if (m_xml.name() == QLatin1String("step")) {
+            const QString text = m_xml.readElementText().trimmed();
+            const int letter = text.isEmpty() ? -1 : text[0].toUpper().unicode() - 'A';
+            step = (letter >= 0 && letter < 7) ? step_semitones[letter] : -1;
+        } else if (m_xml.name() == QLatin1String("alter")) {
+            alter = m_xml.readElementText().toDouble(); // microtones are rounded
+        } else if (m_xml.name() == QLatin1String("octave")) {
+            octave = m_xml.readElementText().toInt();
+        } else {
+            m_xml.skipCurrentElement();
+        }
+    }
+    if (step < 0)
+        return -1;
+    return (octave + 1) * 12 + step + qRound(alter);
+}
+
+qint64 MusicXmlReader::toTicks(const QString &divisions) const
+{
+    return qRound64(divisions.toDouble() * m_score->ticksPerQuarter() / m_divisions);
+}
+
+void MusicXmlReader::reportProgress()
+{
+    // sequential devices have no size, progress of reading them is unknown
+    if (m_progress && !m_file->isSequential() && m_file->size() > 0)
+        m_progress(static_cast<float>(m_file->pos()) / m_file->size());
+}
+
+void MusicXmlReader::addNote(const Note &note)
+{
+    m_score->addNote(note.onset, static_cast<qint32>(note.duration), note.pitch, note.velocity, m_voice);
+}
+
+void MusicXmlReader::flushTiedNotes()
+{
+    for (auto &note : m_tied_notes)
+        addNote(note);
+    m_tied_notes.clear();
+}
@@ -0,0 +1,29 @@
+// Author:  Jakub Precht
+
+#include "pitchquantizer.h"
+
+#include <cmath>
+
+constexpr float PitchQuantizer::m_default_reference_pitch;
+
+PitchQuantizer::PitchQuantizer(float reference_pitch, float hysteresis_cents)
+{
+    setReferencePitch(reference_pitch);
+    setHysteresis(hysteresis_cents);
+}
+
+void PitchQuantizer::setReferencePitch(float reference_pitch)
+{
+    m_reference_pitch = reference_pitch;
+    m_log2_reference = std::log2(reference_pitch);
+}
+
+void PitchQuantizer::setHysteresis(float hysteresis_cents)
+{
+    m_hysteresis = qMax(hysteresis_cents, 0.f) / 100;
+}
+
+float PitchQuantizer::referencePitch() const
+{
+    return m_reference_pitch;
+}
@@ -0,0 +1,198 @@
+// Author:  Jakub Precht
+
+#include "positionoutput.h"
+
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QWebSocket>
+
+#include <cstring>
+
+PositionOutput::PositionOutput(QObject *parent)
+    : QObject(parent), m_udp_socket(this),
+      m_web_socket_server("score-follower", QWebSocketServer::NonSecureMode, this), m_flush_timer(this)
+{
+    connect(&m_flush_timer, &QTimer::timeout, this, &PositionOutput::flush);
+    connect(&m_web_socket_server, &QWebSocketServer::newConnection, this, &PositionOutput::acceptConnection);
+}
+
+bool PositionOutput::configure(const QVector<QString> &osc_targets, int web_socket_port, int interval)
+{
+    bool status = true;
+    m_flush_timer.setInterval(interval);
+
+    m_osc_targets.clear();
+    for (const auto &target : osc_targets) {
+        const int colon = target.lastIndexOf(':');
+        const QString host = target.left(colon);
+        OscTarget osc_target;
+        osc_target.address = host == "localhost" ? QHostAddress(QHostAddress::LocalHost) : QHostAddress(host);
+        osc_target.port = static_cast<quint16>(target.mid(colon + 1).toInt());
+        if (osc_target.address.isNull()) {
+            qWarning().nospace().noquote() << "Invalid OSC target address: " << host << ".";
+            status = false;
+            continue;
+        }
+        m_osc_targets.push_back(osc_target);
+    }
+
+    status &= listen(web_socket_port);
+    schedule(); // new targets get current state
+    return status;
+}
+
+bool PositionOutput::listen(int port)
+{
+    if (m_web_socket_server.isListening() && m_web_socket_server.serverPort() == port)
+        return true;
+
+    m_web_socket_server.close();
+    const QVector<Client> clients = m_clients; // closing removes them
+    for (const auto &client : clients)
+        client.socket->close();
+    if (port == 0)
+        return true;
+    // only local, position tells what is being played
+    if (!m_web_socket_server.listen(QHostAddress::LocalHost, static_cast<quint16>(port))) {
+        qWarning().nospace() << "Failed to publish position on port " << port << ": "
+                             << m_web_socket_server.errorString();
+        return false;
+    }
+    qInfo().nospace() << "Publishing position at ws://localhost:" << port << "/.";
+    return true;
+}
+
+void PositionOutput::publish(int position, int page, float notes_per_second)
+{
+    State state;
+    state.position = position;
+    state.page = page;
+    state.tempo = notes_per_second;
+    if (state == m_state)
+        return;
+
+    m_state = state;
+    schedule();
+}
+
+void PositionOutput::schedule()
+{
+    // first change after a quiet period goes out at once, the following ones with the next tick
+    if (!m_flush_timer.isActive()) {
+        flush();
+        m_flush_timer.start();
+    }
+}
+
+void PositionOutput::acceptConnection()
+{
+    while (m_web_socket_server.hasPendingConnections()) {
+        QWebSocket *socket = m_web_socket_server.nextPendingConnection();
+        Client client;
+        client.socket = socket;
+        m_clients.push_back(client);
+
+        connect(socket, &QWebSocket::disconnected, this, [=]{
+            for (int i = 0; i < m_clients.size(); i++) {
+                if (m_clients[i].socket == socket) {
+                    m_clients.remove(i);
+                    break;
+                }
+            }
+            socket->deleteLater();
+        });
+        connect(socket, &QWebSocket::bytesWritten, this, [=](qint64 bytes){
+            for (auto &it : m_clients) {
+                if (it.socket == socket)
+                    it.unwritten = qMax<qint64>(0, it.unwritten - bytes);
+            }
+        });
+    }
+    schedule(); // new client gets current state
+}
+
+void PositionOutput::flush()
+{
+    bool sent = false;
+    bool behind = false;
+
+    QByteArray bundle;
+    for (auto &target : m_osc_targets) {
+        if (target.has_sent && target.sent == m_state)
+            continue;
+        if (bundle.isEmpty())
+            bundle = oscBundle();
+        m_udp_socket.writeDatagram(bundle, target.address, target.port); // lost datagram is replaced by next one
+        target.sent = m_state;
+        target.has_sent = true;
+        sent = true;
+    }
+
+    QString message;
+    for (auto &client : m_clients) {
+        if (client.has_sent && client.sent == m_state)
+            continue;
+        if (client.unwritten > 0) {
+            behind = true; // still has not taken previous message, gets the latest state once it does
+            continue;
+        }
+        if (message.isEmpty())
+            message = jsonMessage();
+        client.unwritten += client.socket->sendTextMessage(message);
+        client.sent = m_state;
+        client.has_sent = true;
+        sent = true;
+    }
+
+    if (!sent && !behind)
+        m_flush_timer.stop();
+}
+
+QByteArray PositionOutput::oscBundle() const
+{
+    quint32 tempo_bits = 0;
+    std::memcpy(&tempo_bits, &m_state.tempo, sizeof(tempo_bits));
+
+    QByteArray bundle;
+    appendOscString(bundle, "#bundle");
+    appendBigEndian(bundle, 0);
+    appendBigEndian(bundle, 1); // time tag meaning immediately
+    appendOscMessage(bundle, "/scorefollower/position", 'i', static_cast<quint32>(m_state.position));
+    appendOscMessage(bundle, "/scorefollower/page", 'i', static_cast<quint32>(m_state.page));
+    appendOscMessage(bundle, "/scorefollower/tempo", 'f', tempo_bits);
+    return bundle;
+}
+
+QString PositionOutput::jsonMessage() const
+{
+    QJsonObject object;
+    object.insert("position", m_state.position);
+    object.insert("page", m_state.page);
+    object.insert("tempo", m_state.tempo);
+    return QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact));
+}
+
+void PositionOutput::appendOscMessage(QByteArray &bundle, const QByteArray &address, char type, quint32 value)
+{
+    // bundle element is its size followed by the message: address, type tags and the only argument
+    QByteArray message;
+    appendOscString(message, address);
+    appendOscString(message, QByteArray(",") + type);
+    appendBigEndian(message, value);
+    appendBigEndian(bundle, static_cast<quint32>(message.size()));
+    bundle += message;
+}
+
+void PositionOutput::appendOscString(QByteArray &data, const QByteArray &string)
+{
+    // null terminated and padded with nulls to multiple of 4 bytes
+    data += string;
+    data.append(4 - string.size() % 4, '\0');
+}
+
+void PositionOutput::appendBigEndian(QByteArray &data, quint32 value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        data += static_cast<char>((value >> shift) & 0xff);
+}
@@ -2,143 +2,196 @@
 
 #include "recorder.h"
 #include "settings.h"
+#include "audiolog.h"
+#include "latency.h"
+#include "metrics.h"
+#include "trace.h"
 
 #include <QThread>
 #include <QUrl>
 #include <qendian.h>
 #include <QDateTime>
+#include <QtConcurrent>
 
 #include <essentia/algorithmfactory.h>
 
-using namespace essentia;
-using namespace standard;
-
 Recorder::Recorder(QObject *parent)
     : QObject(parent)
 {
     essentia::init();
 }
 
+Recorder::~Recorder()
+{
+    deleteChannels();
+}
+
 bool Recorder::initialize()
 {
-    initializePitchDetector();
+    updateSettings();
 
     m_recorder = new QAudioRecorder(this);
-    m_recorder_settings.setChannelCount(1);
-    m_recorder_settings.setSampleRate(m_settings->sampleRate());
+    // sample rate is left to the device, buffers are resampled to analysis rate
+    m_recorder_settings.setChannelCount(m_settings->inputChannels());
     m_recorder->setEncodingSettings(m_recorder_settings);
     m_recorder->setOutputLocation(QString("/dev/null"));
+    if (!m_audio_input_name.isEmpty())
+        m_recorder->setAudioInput(m_audio_input_name);
 
     m_probe = new QAudioProbe(this);
     connect(m_probe, &QAudioProbe::audioBufferProbed, this, &Recorder::processBuffer);
+    // counted on delivering thread, difference to processed ones is the depth of recorder queue
+    connect(m_probe, &QAudioProbe::audioBufferProbed, this, [=]{
+        Metrics::add(Metrics::BuffersReceived);
+        m_statistics.buffers_received.fetch_add(1, std::memory_order_relaxed);
+    }, Qt::DirectConnection);
     m_probe->setSource(m_recorder);
 
     m_recorder->record();
     if (m_recorder->state() != QAudioRecorder::RecordingState) {
-        qWarning().nospace() << "Failed to create audio input device. Propably unsupported sample rate "
-                             << m_settings->sampleRate() << ".";
+        qWarning().nospace() << "Failed to create audio input device. Propably unsupported number of channels "
+                             << m_settings->inputChannels() << ".";
         return false;
     } else {
         return true;
     }
 }
 
-void Recorder::initializePitchDetector()
+void Recorder::updateSettings()
 {
-    AlgorithmFactory& factory = AlgorithmFactory::instance();
+    // lock free pickup at the start of every buffer; old snapshot is freed by gui once acknowledged
+    quint64 generation = 0;
+    const Settings *settings = m_settings_source->latest(generation);
+    if (generation == m_settings_generation)
+        return;
+    m_settings_generation = generation;
+    if (settings == m_settings) {
+        m_settings_source->acknowledge(m_settings_reader, generation);
+        return;
+    }
 
-    m_window_calculator = factory.create("Windowing", "type", "hann", "zeroPadding", 0);
-    m_spectrum_calculator = factory.create("Spectrum", "size", m_settings->frameSize());
-    m_pitch_detector = factory.create("PitchYinFFT",
-                                      "frameSize", m_settings->frameSize(),
-                                      "sampleRate", m_settings->sampleRate());
+    const bool recreate_channels = m_settings == nullptr || settings->channelParts() != m_settings->channelParts();
+    const bool restart_input = m_settings != nullptr && settings->inputChannels() != m_settings->inputChannels();
+    m_settings = settings;
 
-    m_window_calculator->input("frame").set(m_audio_frame);
-    m_window_calculator->output("frame").set(m_windowed_frame);
+    if (recreate_channels)
+        createChannels();
+    for (auto channel : m_channels) {
+        channel->setSettings(m_settings); // rebuilds its pitch detector when frame size or sample rate changed
+        if (recreate_channels && m_current_format.sampleRate() > 0)
+            channel->setInputRate(m_current_format.sampleRate());
+    }
+    m_channel_values.assign(static_cast<size_t>(m_settings->inputChannels()), 0);
+    // not restarted from inside the probe slot which is delivering a buffer of the recorder
+    if (restart_input && m_recorder != nullptr)
+        QMetaObject::invokeMethod(this, "restartInput", Qt::QueuedConnection);
+    m_settings_source->acknowledge(m_settings_reader, generation);
+}
 
-    m_spectrum_calculator->input("frame").set(m_windowed_frame);
-    m_spectrum_calculator->output("spectrum").set(m_spectrum);
+void Recorder::restartInput()
+{
+    // buffers arriving meanwhile still have the old channel count, missing channels are decoded as silent
+    m_recorder->stop();
+    m_recorder_settings.setChannelCount(m_settings->inputChannels());
+    m_recorder->setEncodingSettings(m_recorder_settings);
+    m_recorder->record();
+}
 
-    m_pitch_detector->input("spectrum").set(m_spectrum);
-    m_pitch_detector->output("pitch").set(m_current_pitch);
-    m_pitch_detector->output("pitchConfidence").set(m_current_confidence);
+void Recorder::createChannels()
+{
+    deleteChannels();
+    for (const auto &channel_part : m_settings->channelParts()) {
+        m_channels.push_back(new ChannelFollower(channel_part));
+        if (m_score != nullptr) {
+            LoadedScore loaded; // no rows prepared, channel allocates them
+            loaded.score = m_score;
+            m_channels.back()->setScore(loaded);
+        }
+    }
+    m_position = -1;
+}
+
+void Recorder::deleteChannels()
+{
+    qDeleteAll(m_channels);
+    m_channels.clear();
 }
 
 void Recorder::processBuffer(const QAudioBuffer buffer)
 {
+    TRACE_SCOPE("audio buffer");
+    m_buffer_time = Latency::now();
+    const qint64 cpu_time = Latency::threadCpuTime();
+    Metrics::add(Metrics::BuffersProcessed);
+    updateSettings();
+
     if (m_settings->verbose()) {
-        auto time = QDateTime::currentDateTime();
-        if (m_current_second != time.toSecsSinceEpoch()) {
+        const qint64 second = QDateTime::currentSecsSinceEpoch();
+        if (m_current_second != second) {
             if (m_current_second != 0) {
-                qInfo().nospace().noquote() << time.toString("hh:mm:ss") << ": " << m_samples_in_current_second << " samples.";
+                AudioLog::write(AudioLog::SamplesPerSecond, m_samples_in_current_second);
                 m_samples_in_current_second = 0;
             } else {
-                qInfo() << "Buffer size: " <<  buffer.sampleCount();
+                AudioLog::write(AudioLog::BufferSize, buffer.sampleCount());
             }
-            m_current_second = time.toSecsSinceEpoch();
+            m_current_second = second;
         }
         m_samples_in_current_second += buffer.sampleCount();
     }
 
     if (buffer.format() != m_current_format) {
+        if (buffer.format().sampleRate() != m_current_format.sampleRate()) {
+            for (auto channel : m_channels)
+                channel->setInputRate(buffer.format().sampleRate());
+            AudioLog::write(AudioLog::InputRate, buffer.format().sampleRate(), m_settings->sampleRate());
+        }
         m_current_format = buffer.format();
         setMaxAmplitude(buffer.format());
     }
 
-    updateLevel(buffer);
-    if (!m_is_following)
-        return;
-
-    convertBufferToAudio(buffer);
-
-    const size_t required_size = static_cast<size_t>(m_settings->frameSize());
-    while (m_audio_frame.size() + m_memory.size() >= required_size) {
-        while (m_audio_frame.size() < required_size) {
-            m_audio_frame.push_back(m_memory.front());
-            m_memory.pop_front();
+    // buffers lost on the way from audio input leave a gap in stream time
+    if (buffer.startTime() >= 0 && buffer.duration() > 0) {
+        const qint64 gap = buffer.startTime() - m_next_buffer_start;
+        if (m_next_buffer_start >= 0 && gap > buffer.duration() / 2) {
+            Metrics::add(Metrics::BuffersDropped, static_cast<quint64>((gap + buffer.duration() / 2) / buffer.duration()));
+            for (auto channel : m_channels)
+                channel->resetInput();
         }
-        processFrame();
-        m_audio_frame.erase(m_audio_frame.begin(), m_audio_frame.begin() + m_settings->hopSize());
-    }
-    while (!m_memory.empty()) {
-        m_audio_frame.push_back(m_memory.front());
-        m_memory.pop_front();
+        m_next_buffer_start = buffer.startTime() + buffer.duration();
     }
+
+    updateLevel(buffer);
+    if (m_is_following)
+        followBuffer(buffer);
+
+    // single writer, so plain stores are enough, except for maximum that reader resets
+    const qint64 processing_time = Latency::now() - m_buffer_time;
+    m_statistics.cpu_time.store(m_statistics.cpu_time.load(std::memory_order_relaxed)
+                                + Latency::threadCpuTime() - cpu_time, std::memory_order_relaxed);
+    m_statistics.processing_time.store(m_statistics.processing_time.load(std::memory_order_relaxed)
+                                       + processing_time, std::memory_order_relaxed);
+    qint64 max_processing_time = m_statistics.max_processing_time.load(std::memory_order_relaxed);
+    while (processing_time > max_processing_time
+           && !m_statistics.max_processing_time.compare_exchange_weak(max_processing_time, processing_time,
+                                                                     std::memory_order_relaxed)) { }
+    m_statistics.buffers_processed.store(m_statistics.buffers_processed.load(std::memory_order_relaxed) + 1,
+                                         std::memory_order_release); // publishes times above
 }
 
-void Recorder::processFrame()
+void Recorder::followBuffer(const QAudioBuffer &buffer)
 {
-    m_window_calculator->compute();
-    m_spectrum_calculator->compute();
-    m_pitch_detector->compute();
-
-    auto &notes_boundry = m_settings->notesFrequencyBoundry();
-    if (m_current_pitch < notes_boundry[m_current_note_number].first || m_current_pitch > notes_boundry[m_current_note_number].second) {
-        int note_number = findNoteFromPitch(m_current_pitch);
-
-        if (m_current_confidence >= m_settings->minimalConfidence()[note_number]) {
-            m_current_note_number = note_number;
-            calculatePosition();
-
-            if (m_settings->verbose() && m_last_was_skipped) {
-                qInfo().nospace() << "Note " << m_last_skipped_note << " was skipped " << m_skipped_count  << " times (<"
-                                  << m_settings->minimalConfidence()[note_number] << ").";
-                m_last_was_skipped = false;
-            }
+    convertBufferToAudio(buffer);
 
-            qInfo().nospace() << "Detected note " << note_number << ".";
-        }
-        else if (m_settings->verbose()){
-            if (m_last_was_skipped && m_last_skipped_note != note_number) {
-                qInfo().nospace() << "Note " << m_last_skipped_note << " was skipped " << m_skipped_count  << " times (<"
-                                  << m_settings->minimalConfidence()[note_number] << ").";
-                m_skipped_count = 0;
-            }
-            m_last_was_skipped = true;
-            m_last_skipped_note = note_number;
-            m_skipped_count++;
-        }
+    // channels share nothing once samples are distributed, a part more costs a core's slice, not latency
+    const qint64 buffer_time = m_buffer_time;
+    if (m_channels.size() == 1) {
+        m_channels[0]->follow(buffer_time);
+    } else {
+        QtConcurrent::blockingMap(m_channels, [=](ChannelFollower *channel){
+            channel->follow(buffer_time);
+        });
     }
+    calculatePosition();
 }
 
 void Recorder::updateLevel(const QAudioBuffer &buffer)
@@ -165,7 +218,7 @@ void Recorder::updateLevel(const QAudioBuffer &buffer)
 
     m_level_count++;
     if (m_level_count == m_max_level_count) {
-        emit levelChanged(m_level / m_max_level_count);
+        m_level_output->store(m_level / m_max_level_count);
         m_level = 0;
         m_level_count = 0;
     }
@@ -173,71 +226,101 @@ void Recorder::updateLevel(const QAudioBuffer &buffer)
 
 void Recorder::convertBufferToAudio(const QAudioBuffer &buffer)
 {
+    TRACE_SCOPE("conversion");
     const unsigned char *ptr = reinterpret_cast<const unsigned char*>(buffer.data());
     const auto format = buffer.format();
     const int channel_bytes = format.sampleSize() / 8;
-
-    const size_t required_size = static_cast<size_t>(m_settings->frameSize());
-    for (int i = 0; i < buffer.sampleCount(); i++) {
-        float value = 0;
-
-        if (format.sampleSize() == 8) {
-            value = *reinterpret_cast<const qint8*>(ptr);
-        } else if (format.sampleSize() == 16 ) {
-            if (format.byteOrder() == QAudioFormat::LittleEndian)
-                value = qFromLittleEndian<qint16>(ptr);
-            else
-                value = qFromBigEndian<qint16>(ptr);
-        } else if (format.sampleSize() == 32 && (format.sampleType() == QAudioFormat::UnSignedInt
-                                                 || format.sampleType() == QAudioFormat::SignedInt)) {
-            if (format.byteOrder() == QAudioFormat::LittleEndian)
-                value = qFromLittleEndian<quint32>(ptr);
-            else
-                value = qFromBigEndian<quint32>(ptr);
-        } else if (format.sampleSize() == 32 && format.sampleType() == QAudioFormat::Float) {
-            value = *reinterpret_cast<const float*>(ptr);
-        } else {
-            qDebug() << "Unsupported audio format.";
+    // device may give fewer channels than requested, missing ones stay silent
+    const int channels_count = qMin(format.channelCount(), static_cast<int>(m_channel_values.size()));
+    const int skipped_bytes = (format.channelCount() - channels_count) * channel_bytes;
+
+    // samples are de-interleaved and mixed for every channel follower in one pass
+    bool is_supported = true;
+    for (int i = 0; i < buffer.frameCount(); i++) {
+        for (int channel = 0; channel < channels_count; channel++) {
+            float value = 0;
+
+            if (format.sampleSize() == 8) {
+                value = *reinterpret_cast<const qint8*>(ptr);
+            } else if (format.sampleSize() == 16 ) {
+                if (format.byteOrder() == QAudioFormat::LittleEndian)
+                    value = qFromLittleEndian<qint16>(ptr);
+                else
+                    value = qFromBigEndian<qint16>(ptr);
+            } else if (format.sampleSize() == 32 && (format.sampleType() == QAudioFormat::UnSignedInt
+                                                     || format.sampleType() == QAudioFormat::SignedInt)) {
+                if (format.byteOrder() == QAudioFormat::LittleEndian)
+                    value = qFromLittleEndian<quint32>(ptr);
+                else
+                    value = qFromBigEndian<quint32>(ptr);
+            } else if (format.sampleSize() == 32 && format.sampleType() == QAudioFormat::Float) {
+                value = *reinterpret_cast<const float*>(ptr);
+            } else {
+                is_supported = false;
+            }
+            ptr += channel_bytes;
+            m_channel_values[static_cast<size_t>(channel)] = value;
+        }
+        ptr += skipped_bytes;
+
+        for (auto follower : m_channels) {
+            const QVector<int> &mixed = follower->channelPart().channels;
+            float value = m_channel_values[static_cast<size_t>(mixed[0])];
+            for (int j = 1; j < mixed.size(); j++)
+                value += m_channel_values[static_cast<size_t>(mixed[j])];
+            follower->addSample(value * follower->mixScale());
         }
-        ptr += channel_bytes;
-
-        if (m_audio_frame.size() < required_size)
-            m_audio_frame.push_back(value);
-        else
-            m_memory.push_back(value);
     }
+    if (!is_supported)
+        AudioLog::write(AudioLog::UnsupportedFormat);
 }
 
 void Recorder::resetDtw()
 {
     m_position = -1;
-    m_dtw_row.fill(0);
+    for (auto channel : m_channels)
+        channel->reset();
 }
 
 void Recorder::calculatePosition()
 {
-    // dtw algorithm
-    m_next_row[0] = qAbs(m_current_note_number - m_score_notes[0]) + m_dtw_row[0];
-
+    // parts move at their own pace, the one furthest in the score tells where the ensemble is
     int position = 0;
-    int64_t min_value = m_next_row[0];
-    for (int i = 1; i < m_dtw_row.size(); i++) {
-        m_next_row[i] = qAbs(m_current_note_number - m_score_notes[i]) + qMin(m_next_row[i - 1], qMin(m_dtw_row[i], m_dtw_row[i-1]));
-        if (m_next_row[i] < min_value) {
-            position = i;
-            min_value = m_next_row[i];
-        }
-    }
+    for (auto channel : m_channels)
+        position = qMax(position, channel->playedNotes());
+    if (position == 0 || position == m_position)
+        return;
 
-    m_dtw_row.swap(m_next_row); // fast swap
-    if (position != m_position)
-        emit positionChanged(position + 1);
+    m_position_time_output->store(m_buffer_time); // before position, so it is never older than it
+    m_position_output->store(position);
+    Latency::record(Latency::PositionUpdated, m_buffer_time);
     m_position = position;
 }
 
-void Recorder::setSettings(const Settings *settings)
+void Recorder::setSettingsSource(SettingsSource *source)
 {
-    m_settings = settings;
+    m_settings_source = source;
+    m_settings_reader = m_settings_source->addReader();
+}
+
+void Recorder::setOutputs(LatestValue<int> *position, LatestValue<qint64> *position_time, LatestValue<float> *level)
+{
+    m_position_output = position;
+    m_position_time_output = position_time;
+    m_level_output = level;
+}
+
+void Recorder::setAudioInput(QString audio_input)
+{
+    // takes effect with initialize, or right away once recording
+    m_audio_input_name = audio_input;
+    if (m_recorder != nullptr)
+        m_recorder->setAudioInput(m_audio_input_name);
+}
+
+RecorderStatistics &Recorder::statistics()
+{
+    return m_statistics;
 }
 
 void Recorder::setMaxAmplitude(const QAudioFormat &format)
@@ -290,35 +373,20 @@ void Recorder::setMaxAmplitude(const QAudioFormat &format)
     m_max_amplitude /= 4; // because this way level bar changes are more visible
 }
 
-void Recorder::setScore(const QVector<int> &scoreNotes)
+void Recorder::setScore(LoadedScore score)
 {
-    m_score_notes = scoreNotes;
-    m_dtw_row.resize(m_score_notes.size());
-    m_next_row.resize(m_score_notes.size());
+    // queued from gui, so it always lands between two buffers; rows come allocated from loader
+    m_score = score.score;
+    for (auto channel : m_channels)
+        channel->setScore(score);
     resetDtw();
 }
 
-int Recorder::findNoteFromPitch(float pitch)
-{
-    auto &notes_boundry = m_settings->notesFrequencyBoundry();
-    int beg = 0, end = notes_boundry.size() - 1;
-    while (beg < end) {
-        int mid = (beg + end) / 2;
-        if (notes_boundry[mid].second < pitch)
-            beg = mid + 1;
-        else if (notes_boundry[mid].first > pitch)
-            end = mid - 1;
-        else
-            beg = end = mid;
-    }
-    return beg;
-}
-
 void Recorder::startFollowing()
 {
     resetDtw();
     m_is_following = true;
-    emit positionChanged(0);
+    m_position_output->store(0);
     qInfo() << "Started score following.";
 }
 
@@ -0,0 +1,74 @@
+// Author:  Jakub Precht
+
+#include "resampler.h"
+#include "audiolog.h"
+
+#include <QDebug>
+
+#include <samplerate.h>
+
+#include <cmath>
+
+const int Resampler::m_max_input;
+
+Resampler::~Resampler()
+{
+    if (m_state != nullptr)
+        src_delete(m_state);
+}
+
+bool Resampler::setRates(int input_rate, int output_rate)
+{
+    if (m_state != nullptr)
+        m_state = src_delete(m_state);
+    m_ratio = static_cast<double>(output_rate) / input_rate;
+    if (!isActive())
+        return true;
+
+    // fastest sinc converter still keeps 97 dB of snr in 80% of bandwidth, far more than pitch detection needs
+    int error = 0;
+    m_state = src_new(SRC_SINC_FASTEST, 1, &error);
+    if (m_state == nullptr) {
+        qWarning().nospace() << "Failed to create resampler from " << input_rate << " to " << output_rate
+                             << " Hz: " << src_strerror(error);
+        m_ratio = 1;
+        return false;
+    }
+    m_output.resize(static_cast<size_t>(std::ceil(m_max_input * m_ratio)) + 64);
+    return true;
+}
+
+bool Resampler::isActive() const
+{
+    return m_ratio != 1;
+}
+
+void Resampler::reset()
+{
+    if (m_state != nullptr)
+        src_reset(m_state);
+}
+
+int Resampler::process(const float *input, int count)
+{
+    SRC_DATA data;
+    data.data_in = input;
+    data.data_out = m_output.data();
+    data.input_frames = qMin(count, m_max_input);
+    data.output_frames = static_cast<long>(m_output.size());
+    data.end_of_input = 0;
+    data.src_ratio = m_ratio;
+
+    // output has room for all of input, so one call consumes it
+    const int error = src_process(m_state, &data);
+    if (error != 0) {
+        AudioLog::write(AudioLog::ResamplingFailed, error);
+        return 0;
+    }
+    return static_cast<int>(data.output_frames_gen);
+}
+
+const float *Resampler::output() const
+{
+    return m_output.data();
+}
@@ -0,0 +1,169 @@
+// Author:  Jakub Precht
+
+#include "scorefile.h"
+
+#include <QDebug>
+#include <QSaveFile>
+#include <cstring>
+
+const char ScoreFile::m_extension[] = "sfs";
+const char ScoreFile::m_magic[4] = { 'S', 'F', 'S', 'C' };
+const quint32 ScoreFile::m_version;
+const quint32 ScoreFile::m_byte_order_mark;
+const quint64 ScoreFile::m_alignment;
+
+bool ScoreFile::write(const ScoreModel &score, const QString &filename)
+{
+    struct SectionData
+    {
+        Section id;
+        quint32 element_size;
+        const void *data;
+        quint64 count;
+    };
+
+    const ScoreArrays &arrays = score.arrays();
+    const quint64 notes = static_cast<quint64>(arrays.notes_count);
+    const quint64 tempo_changes = static_cast<quint64>(arrays.tempo_changes_count);
+    const QVector<SectionData> sections = {
+        { Section::Onsets, sizeof(qint64), arrays.onsets, notes },
+        { Section::Durations, sizeof(qint32), arrays.durations, notes },
+        { Section::Pitches, sizeof(quint8), arrays.pitches, notes },
+        { Section::Velocities, sizeof(quint8), arrays.velocities, notes },
+        { Section::Voices, sizeof(quint8), arrays.voices, notes },
+        { Section::ChordGroups, sizeof(qint32), arrays.chord_groups, notes },
+        { Section::TempoTicks, sizeof(qint64), arrays.tempo_ticks, tempo_changes },
+        { Section::Tempos, sizeof(qint32), arrays.tempos, tempo_changes },
+        { Section::TempoSeconds, sizeof(double), arrays.tempo_seconds, tempo_changes }
+    };
+
+    Header header;
+    std::memcpy(header.magic, m_magic, sizeof(m_magic));
+    header.version = m_version;
+    header.byte_order_mark = m_byte_order_mark;
+    header.ticks_per_quarter = score.ticksPerQuarter();
+    header.notes_count = static_cast<quint32>(notes);
+    header.tempo_changes_count = static_cast<quint32>(tempo_changes);
+    header.sections_count = static_cast<quint32>(sections.size());
+    header.reserved = 0;
+
+    auto align = [](quint64 offset) { return (offset + m_alignment - 1) / m_alignment * m_alignment; };
+    QVector<SectionEntry> entries;
+    quint64 offset = align(sizeof(Header) + sections.size() * sizeof(SectionEntry));
+    for (auto &section : sections) {
+        entries.push_back({ static_cast<quint32>(section.id), section.element_size, offset, section.count });
+        offset = align(offset + section.element_size * section.count);
+    }
+
+    // written aside and renamed, so processes having the old file mapped are not affected
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open: " << filename;
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(entries.constData()), entries.size() * sizeof(SectionEntry));
+    for (int i = 0; i < sections.size(); i++) {
+        const QByteArray padding(static_cast<int>(entries[i].offset - static_cast<quint64>(file.pos())), '\0');
+        file.write(padding);
+        file.write(reinterpret_cast<const char *>(sections[i].data),
+                   static_cast<qint64>(sections[i].element_size * sections[i].count));
+    }
+
+    if (!file.commit()) {
+        qWarning() << "Failed to write: " << filename;
+        return false;
+    }
+    return true;
+}
+
+ScorePointer ScoreFile::map(const QString &filename)
+{
+    QSharedPointer<QFile> file = QSharedPointer<QFile>::create(filename);
+    if (!file->open(QIODevice::ReadOnly)) {
+        qDebug() << "Failed to open: " << filename;
+        return ScorePointer::create();
+    }
+
+    const quint64 file_size = static_cast<quint64>(file->size());
+    const uchar *data = file_size >= sizeof(Header) ? file->map(0, file->size()) : nullptr;
+    if (data == nullptr) {
+        qWarning() << "Failed to map score file: " << filename;
+        return ScorePointer::create();
+    }
+
+    const Header *header = reinterpret_cast<const Header *>(data);
+    if (std::memcmp(header->magic, m_magic, sizeof(m_magic)) != 0 || header->version != m_version
+            || header->byte_order_mark != m_byte_order_mark
+            || sizeof(Header) + header->sections_count * sizeof(SectionEntry) > file_size) {
+        qWarning() << "Not a score file or unsupported version: " << filename;
+        return ScorePointer::create();
+    }
+
+    ScoreArrays arrays;
+    arrays.notes_count = static_cast<int>(header->notes_count);
+    arrays.tempo_changes_count = static_cast<int>(header->tempo_changes_count);
+
+    bool ok = true;
+    const SectionEntry *entries = reinterpret_cast<const SectionEntry *>(data + sizeof(Header));
+    for (quint32 i = 0; i < header->sections_count; i++) {
+        const SectionEntry &entry = entries[i];
+        auto section = [&](quint32 element_size, quint64 count) -> const void * {
+            if (entry.element_size != element_size || entry.count != count || entry.offset % m_alignment != 0
+                    || entry.offset > file_size || element_size * count > file_size - entry.offset) {
+                ok = false;
+                return nullptr;
+            }
+            return data + entry.offset;
+        };
+
+        switch (static_cast<Section>(entry.id)) {
+        case Section::Onsets:
+            arrays.onsets = static_cast<const qint64 *>(section(sizeof(qint64), header->notes_count));
+            break;
+        case Section::Durations:
+            arrays.durations = static_cast<const qint32 *>(section(sizeof(qint32), header->notes_count));
+            break;
+        case Section::Pitches:
+            arrays.pitches = static_cast<const quint8 *>(section(sizeof(quint8), header->notes_count));
+            break;
+        case Section::Velocities:
+            arrays.velocities = static_cast<const quint8 *>(section(sizeof(quint8), header->notes_count));
+            break;
+        case Section::Voices:
+            arrays.voices = static_cast<const quint8 *>(section(sizeof(quint8), header->notes_count));
+            break;
+        case Section::ChordGroups:
+            arrays.chord_groups = static_cast<const qint32 *>(section(sizeof(qint32), header->notes_count));
+            break;
+        case Section::TempoTicks:
+            arrays.tempo_ticks = static_cast<const qint64 *>(section(sizeof(qint64), header->tempo_changes_count));
+            break;
+        case Section::Tempos:
+            arrays.tempos = static_cast<const qint32 *>(section(sizeof(qint32), header->tempo_changes_count));
+            break;
+        case Section::TempoSeconds:
+            arrays.tempo_seconds = static_cast<const double *>(section(sizeof(double), header->tempo_changes_count));
+            break;
+        default:
+            break; // section added by newer version
+        }
+    }
+
+    ok &= arrays.onsets && arrays.durations && arrays.pitches && arrays.velocities && arrays.voices
+            && arrays.chord_groups && arrays.tempo_ticks && arrays.tempos && arrays.tempo_seconds;
+
+    // pitches index tables of 128 midi notes and chord groups are consecutive from 0, checked once here
+    // so no reader of the mapped arrays has to; every byte is a valid voice
+    for (int i = 0; ok && i < arrays.notes_count; i++) {
+        const qint32 previous_group = i > 0 ? arrays.chord_groups[i - 1] : -1;
+        ok = arrays.pitches[i] <= 127 && arrays.velocities[i] <= 127
+                && (arrays.chord_groups[i] == previous_group || arrays.chord_groups[i] == previous_group + 1);
+    }
+    if (!ok) {
+        qWarning() << "Corrupted score file: " << filename;
+        return ScorePointer::create();
+    }
+
+    return ScorePointer::create(header->ticks_per_quarter, arrays, file);
+}
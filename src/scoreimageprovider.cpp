@@ -0,0 +1,65 @@
+// Author:  Jakub Precht
+
+#include "scoreimageprovider.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <QPainter>
+
+ScoreImageProvider::ScoreImageProvider()
+    : QQuickImageProvider(QQuickImageProvider::Image)
+{ }
+
+void ScoreImageProvider::setPages(const QVector<QImage> &pages)
+{
+    QMutexLocker locker(&m_mutex);
+    m_pages = pages;
+    m_vector_pages.clear();
+}
+
+void ScoreImageProvider::setVectorPages(const QVector<QByteArray> &documents, const QSize &page_size)
+{
+    QVector<QSharedPointer<QSvgRenderer>> vector_pages;
+    for (auto &document : documents)
+        vector_pages.push_back(QSharedPointer<QSvgRenderer>::create(document));
+
+    QMutexLocker locker(&m_mutex);
+    m_pages.clear();
+    m_vector_pages = vector_pages;
+    m_page_size = page_size;
+}
+
+QImage ScoreImageProvider::requestImage(const QString &id, QSize *size, const QSize &requested_size)
+{
+    // id is "<revision>/<page>", revision only makes urls of new renders unique for QML's pixmap cache
+    const QStringList pieces = id.split('/');
+    bool ok = pieces.size() == 2;
+    const int page = ok ? pieces[1].toInt(&ok) : 0;
+
+    QMutexLocker locker(&m_mutex);
+    if (!ok || page < 1 || page > qMax(m_pages.size(), m_vector_pages.size())) {
+        qWarning() << "Requested unknown score page:" << id;
+        return QImage();
+    }
+
+    if (!m_vector_pages.isEmpty()) {
+        QSize image_size = m_page_size;
+        if (requested_size.width() > 0 && requested_size.height() > 0)
+            image_size = m_page_size.scaled(requested_size, Qt::KeepAspectRatio);
+
+        QImage image(image_size, QImage::Format_RGB32);
+        image.fill(Qt::white);
+        QPainter painter(&image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        m_vector_pages[page - 1]->render(&painter);
+        painter.end();
+        if (size)
+            *size = m_page_size; // layout is computed in units of bitmap at settings dpi
+        return image;
+    }
+
+    const QImage &image = m_pages[page - 1]; // shared, not copied
+    if (size)
+        *size = image.size();
+    return image;
+}
@@ -0,0 +1,80 @@
+// Author:  Jakub Precht
+
+#include "scorelayout.h"
+
+#include <QDebug>
+
+void ScoreLayout::build(const QVector<QVector<int>> &indicator_ys, const QVector<int> &indicator_xs)
+{
+    int notes_count = 0;
+    for (auto &page_ys : indicator_ys)
+        notes_count += page_ys.size() * indicator_xs.size();
+
+    m_pages.resize(notes_count);
+    m_xs.resize(notes_count);
+    m_ys.resize(notes_count);
+    m_page_first_notes.resize(indicator_ys.size() + 1);
+
+    int note = 0;
+    for (int page = 0; page < indicator_ys.size(); page++) {
+        m_page_first_notes[page] = note;
+        for (int y : indicator_ys[page]) {
+            for (int x : indicator_xs) {
+                m_pages[note] = page + 1;
+                m_xs[note] = x;
+                m_ys[note] = y;
+                note++;
+            }
+        }
+    }
+    m_page_first_notes[indicator_ys.size()] = note;
+}
+
+int ScoreLayout::notesCount() const
+{
+    return m_pages.size();
+}
+
+int ScoreLayout::pagesNumber() const
+{
+    return m_page_first_notes.size() - 1;
+}
+
+int ScoreLayout::page(int note) const
+{
+    if (note < 0 || note >= m_pages.size())
+        return m_pages.isEmpty() ? 0 : m_pages.back();
+    return m_pages[note];
+}
+
+int ScoreLayout::x(int note) const
+{
+    if (note < 0 || note >= m_xs.size()) {
+        qWarning() << "wrong indicator index:" << note;
+        return 0;
+    }
+    return m_xs[note];
+}
+
+int ScoreLayout::y(int note) const
+{
+    if (note < 0 || note >= m_ys.size()) {
+        qWarning() << "wrong indicator index:" << note;
+        return 0;
+    }
+    return m_ys[note];
+}
+
+int ScoreLayout::pageFirstNote(int page) const
+{
+    if (page < 1 || page > pagesNumber())
+        return 0;
+    return m_page_first_notes[page - 1];
+}
+
+int ScoreLayout::pageNotesCount(int page) const
+{
+    if (page < 1 || page > pagesNumber())
+        return 0;
+    return m_page_first_notes[page] - m_page_first_notes[page - 1];
+}
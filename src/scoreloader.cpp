@@ -0,0 +1,39 @@
+// Author:  Jakub Precht
+
+#include "scoreloader.h"
+#include "scorereader.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+const int ScoreLoader::m_progress_interval;
+constexpr float ScoreLoader::m_reading_share;
+
+ScoreLoader::ScoreLoader(QObject *parent)
+    : QObject(parent)
+{ }
+
+void ScoreLoader::loadScore(const QString &filename)
+{
+    emit progressChanged(0);
+    QElapsedTimer since_report;
+    since_report.start();
+    auto report_reading = [&](float progress){
+        if (since_report.elapsed() >= m_progress_interval) {
+            since_report.restart();
+            emit progressChanged(progress * m_reading_share);
+        }
+    };
+
+    LoadedScore loaded;
+    loaded.filename = filename;
+    loaded.score = ScoreReader::readScoreFile(filename, report_reading);
+    if (loaded.score->isEmpty())
+        qWarning() << "No notes read from: " << filename;
+    emit progressChanged(m_reading_share);
+
+    loaded.rows->dtw_row.fill(0, loaded.score->size());
+    loaded.rows->next_row.fill(0, loaded.score->size());
+    emit progressChanged(1);
+    emit finishedLoading(loaded);
+}
@@ -0,0 +1,178 @@
+// Author:  Jakub Precht
+
+#include "scoremodel.h"
+
+#include <algorithm>
+#include <numeric>
+
+const int ScoreModel::m_default_ticks_per_quarter;
+const qint32 ScoreModel::m_default_tempo;
+
+ScoreModel::ScoreModel(int ticks_per_quarter)
+    : m_ticks_per_quarter(ticks_per_quarter > 0 ? ticks_per_quarter : m_default_ticks_per_quarter)
+{ }
+
+ScoreModel::ScoreModel(int ticks_per_quarter, const ScoreArrays &arrays, const QSharedPointer<QFile> &mapped_file)
+    : m_ticks_per_quarter(ticks_per_quarter > 0 ? ticks_per_quarter : m_default_ticks_per_quarter),
+      m_arrays(arrays), m_mapped_file(mapped_file)
+{ }
+
+void ScoreModel::addNote(qint64 onset, qint32 duration, int pitch, int velocity, int voice)
+{
+    m_onsets.push_back(onset);
+    m_durations.push_back(duration);
+    m_pitches.push_back(static_cast<quint8>(qBound(0, pitch, 127)));
+    m_velocities.push_back(static_cast<quint8>(qBound(0, velocity, 127)));
+    m_voices.push_back(static_cast<quint8>(qBound(0, voice, 255)));
+}
+
+void ScoreModel::addTempoChange(qint64 tick, qint32 microseconds_per_quarter)
+{
+    m_tempo_ticks.push_back(tick);
+    m_tempos.push_back(microseconds_per_quarter);
+}
+
+void ScoreModel::finish()
+{
+    // notes by onset, chords from top voice and highest note down
+    QVector<int> order(m_onsets.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b){
+        if (m_onsets[a] != m_onsets[b])
+            return m_onsets[a] < m_onsets[b];
+        if (m_voices[a] != m_voices[b])
+            return m_voices[a] < m_voices[b];
+        return m_pitches[a] > m_pitches[b];
+    });
+
+    auto reorder = [&](auto &values) {
+        auto sorted = values;
+        for (int i = 0; i < order.size(); i++)
+            sorted[i] = values[order[i]];
+        values.swap(sorted);
+    };
+    reorder(m_onsets);
+    reorder(m_durations);
+    reorder(m_pitches);
+    reorder(m_velocities);
+    reorder(m_voices);
+
+    m_chord_groups.resize(m_onsets.size());
+    for (int i = 0, group = -1; i < m_onsets.size(); i++) {
+        if (i == 0 || m_onsets[i] != m_onsets[i - 1])
+            group++;
+        m_chord_groups[i] = group;
+    }
+
+    // tempo map always starts at tick 0, time of each change is precomputed
+    QVector<int> tempo_order(m_tempo_ticks.size());
+    std::iota(tempo_order.begin(), tempo_order.end(), 0);
+    std::stable_sort(tempo_order.begin(), tempo_order.end(), [&](int a, int b){
+        return m_tempo_ticks[a] < m_tempo_ticks[b];
+    });
+    QVector<qint64> tempo_ticks = { 0 };
+    QVector<qint32> tempos = { m_default_tempo };
+    for (int i : tempo_order) {
+        if (m_tempo_ticks[i] == tempo_ticks.back())
+            tempos.back() = m_tempos[i];
+        else {
+            tempo_ticks.push_back(m_tempo_ticks[i]);
+            tempos.push_back(m_tempos[i]);
+        }
+    }
+    m_tempo_ticks.swap(tempo_ticks);
+    m_tempos.swap(tempos);
+
+    m_tempo_seconds.resize(m_tempo_ticks.size());
+    m_tempo_seconds[0] = 0;
+    for (int i = 1; i < m_tempo_ticks.size(); i++) {
+        m_tempo_seconds[i] = m_tempo_seconds[i - 1] + (m_tempo_ticks[i] - m_tempo_ticks[i - 1])
+                * m_tempos[i - 1] / (1e6 * m_ticks_per_quarter);
+    }
+
+    m_arrays.notes_count = m_pitches.size();
+    m_arrays.onsets = m_onsets.constData();
+    m_arrays.durations = m_durations.constData();
+    m_arrays.pitches = m_pitches.constData();
+    m_arrays.velocities = m_velocities.constData();
+    m_arrays.voices = m_voices.constData();
+    m_arrays.chord_groups = m_chord_groups.constData();
+    m_arrays.tempo_changes_count = m_tempo_ticks.size();
+    m_arrays.tempo_ticks = m_tempo_ticks.constData();
+    m_arrays.tempos = m_tempos.constData();
+    m_arrays.tempo_seconds = m_tempo_seconds.constData();
+}
+
+int ScoreModel::size() const
+{
+    return m_arrays.notes_count;
+}
+
+bool ScoreModel::isEmpty() const
+{
+    return m_arrays.notes_count == 0;
+}
+
+int ScoreModel::ticksPerQuarter() const
+{
+    return m_ticks_per_quarter;
+}
+
+int ScoreModel::voicesCount() const
+{
+    if (m_arrays.notes_count == 0)
+        return 0;
+    return *std::max_element(m_arrays.voices, m_arrays.voices + m_arrays.notes_count) + 1;
+}
+
+double ScoreModel::seconds(qint64 tick) const
+{
+    if (m_arrays.tempo_changes_count == 0) // not finished yet
+        return tick * (m_default_tempo / (1e6 * m_ticks_per_quarter));
+
+    const qint64 *ticks_end = m_arrays.tempo_ticks + m_arrays.tempo_changes_count;
+    int change = static_cast<int>(std::upper_bound(m_arrays.tempo_ticks, ticks_end, tick) - m_arrays.tempo_ticks) - 1;
+    change = qMax(change, 0);
+    return m_arrays.tempo_seconds[change]
+            + (tick - m_arrays.tempo_ticks[change]) * m_arrays.tempos[change] / (1e6 * m_ticks_per_quarter);
+}
+
+const qint64 *ScoreModel::onsets() const
+{
+    return m_arrays.onsets;
+}
+
+const qint32 *ScoreModel::durations() const
+{
+    return m_arrays.durations;
+}
+
+const quint8 *ScoreModel::pitches() const
+{
+    return m_arrays.pitches;
+}
+
+const quint8 *ScoreModel::velocities() const
+{
+    return m_arrays.velocities;
+}
+
+const quint8 *ScoreModel::voices() const
+{
+    return m_arrays.voices;
+}
+
+const qint32 *ScoreModel::chordGroups() const
+{
+    return m_arrays.chord_groups;
+}
+
+int ScoreModel::pitch(int note) const
+{
+    return m_arrays.pitches[note];
+}
+
+const ScoreArrays &ScoreModel::arrays() const
+{
+    return m_arrays;
+}
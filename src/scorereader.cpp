@@ -1,6 +1,8 @@
 // Author:  Jakub Precht
 
 #include "scorereader.h"
+#include "scorefile.h"
+#include "musicxmlreader.h"
 
 #include "MidiFile.h"
 
@@ -9,62 +11,89 @@
 #include <QFile>
 #include <QDebug>
 
-int ScoreReader::m_midi_note_on_action_code = 144;
+const int ScoreReader::m_percussion_channel;
 
-QVector<int> ScoreReader::readScoreFile(const QString &filename)
+ScorePointer ScoreReader::readScoreFile(const QString &filename, const ProgressCallback &progress)
 {
     QFileInfo info(filename);
     auto file_extension = info.suffix();
     if (!info.exists()) {
         qDebug() << "File don't exists: " << filename;
-        return QVector<int>();
+        return ScorePointer::create();
+    }
+
+    if (file_extension == ScoreFile::m_extension)
+        return ScoreFile::map(filename);
+
+    // precompiled sibling (see --convert) is used while it is up to date
+    QFileInfo precompiled(filename + "." + ScoreFile::m_extension);
+    if (precompiled.exists() && precompiled.lastModified() >= info.lastModified()) {
+        ScorePointer score = ScoreFile::map(precompiled.filePath());
+        if (!score->isEmpty())
+            return score;
     }
 
     if (file_extension == "mid")
-        return readMidiFile(filename);
+        return readMidiFile(filename, progress);
+    else if (file_extension == "xml" || file_extension == "musicxml" || file_extension == "mxl")
+        return MusicXmlReader::readFile(filename, progress);
     else
-        return readTextFile(filename);
+        return readTextFile(filename, progress);
 }
 
-QVector<int> ScoreReader::readTextFile(const QString &filename)
+ScorePointer ScoreReader::readTextFile(const QString &filename, const ProgressCallback &progress)
 {
-    QVector<int> score_notes;
+    // plain sequence of note numbers, each one gets a quarter
+    QSharedPointer<ScoreModel> score = QSharedPointer<ScoreModel>::create();
     QFile score_file(filename);
     if (score_file.open(QIODevice::ReadOnly | QIODevice::Text)) {
         QTextStream in(&score_file);
         QString note_number;
+        const int quarter = score->ticksPerQuarter();
+        qint64 onset = 0;
         while (!in.atEnd()) {
             in >> note_number;
-            if (!note_number.isEmpty())
-                score_notes.push_back(note_number.toInt());
+            if (!note_number.isEmpty()) {
+                score->addNote(onset, quarter, note_number.toInt(), 64, 0);
+                onset += quarter;
+            }
+            if (progress && score_file.size() > 0)
+                progress(static_cast<float>(score_file.pos()) / score_file.size()); // ahead by buffer of stream
         }
         score_file.close();
     } else {
         qDebug() << "Failed to open: " << filename;
     }
-    return score_notes;
+    score->finish();
+    return score;
 }
 
-QVector<int> ScoreReader::readMidiFile(const QString &filename)
+ScorePointer ScoreReader::readMidiFile(const QString &filename, const ProgressCallback &progress)
 {
     smf::MidiFile midifile;
-    midifile.read(filename.toStdString());
-    if (midifile.getTrackCount() > 1) {
-        qDebug() << "Failed reading midi score - it contains multiple tracks";
-        return QVector<int>();
+    if (!midifile.read(filename.toStdString())) {
+        qDebug() << "Failed reading midi score: " << filename;
+        return ScorePointer::create();
     }
+    midifile.linkNotePairs(); // for note durations
 
-    QVector<int> score_notes;
-    const int track = 0;
-    for (int event = 0; event < midifile[track].size(); event++) {
-        if (midifile[track][event].size() < 3)
-            continue;
-        int action = midifile[track][event][0];
-        int note = midifile[track][event][1];
-        int volume = midifile[track][event][2];
-        if (action == m_midi_note_on_action_code && volume > 0)
-            score_notes.push_back(note);
+    // ticks stay absolute after reading; voice is the track, or the channel in single track files;
+    // drums carry no melody to follow, so percussion channel is left out of the model
+    QSharedPointer<ScoreModel> score = QSharedPointer<ScoreModel>::create(midifile.getTicksPerQuarterNote());
+    const bool single_track = midifile.getTrackCount() == 1;
+    for (int track = 0; track < midifile.getTrackCount(); track++) {
+        for (int event = 0; event < midifile[track].size(); event++) {
+            smf::MidiEvent &midi_event = midifile[track][event];
+            if (midi_event.isTempo()) {
+                score->addTempoChange(midi_event.tick, midi_event.getTempoMicroseconds());
+            } else if (midi_event.isNoteOn() && midi_event.getChannel() != m_percussion_channel) {
+                score->addNote(midi_event.tick, midi_event.getTickDuration(), midi_event.getKeyNumber(),
+                               midi_event.getVelocity(), single_track ? midi_event.getChannel() : track);
+            }
+        }
+        if (progress)
+            progress(static_cast<float>(track + 1) / midifile.getTrackCount()); // parsing itself is not divided
     }
-
-    return score_notes;
+    score->finish();
+    return score;
 }
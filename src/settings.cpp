@@ -13,7 +13,7 @@
 
 bool Settings::readSettings()
 {
-    QString m_settings_filename = QApplication::applicationDirPath() + "/settings.json";
+    QString m_settings_filename = settingsFilename();
     QFileInfo check_file(m_settings_filename);
     if (check_file.exists() && check_file.isFile()) {
         m_status = true;
@@ -30,6 +30,21 @@ bool Settings::readSettings()
     return m_status;
 }
 
+QString Settings::settingsFilename()
+{
+    return QApplication::applicationDirPath() + "/settings.json";
+}
+
+bool Settings::hasSameLayout(const Settings &other) const
+{
+    return m_dpi == other.m_dpi && m_vector_score == other.m_vector_score
+            && m_staff_indent == other.m_staff_indent && m_notes_per_staff == other.m_notes_per_staff
+            && m_staffs_per_page == other.m_staffs_per_page && m_indicator_xs == other.m_indicator_xs
+            && m_lilypond_notes_notation == other.m_lilypond_notes_notation
+            && m_lilypond_working_directory == other.m_lilypond_working_directory
+            && m_lilypond_header == other.m_lilypond_header && m_lilypond_footer == other.m_lilypond_footer;
+}
+
 bool Settings::readSettings(const QString &filename)
 {
     QFile file(filename);
@@ -43,6 +58,7 @@ bool Settings::readSettings(const QString &filename)
 
     m_status = true;
     m_sample_rate = static_cast<int>(readNumber("sampleRate"));
+    m_input_channels = static_cast<int>(readNumber("inputChannels"));
     m_frame_size = static_cast<int>(readNumber("frameSize"));
     m_hop_size = static_cast<int>(readNumber("hopSize"));
     m_indicator_width = static_cast<int>(readNumber("indicatorWidth"));
@@ -51,20 +67,78 @@ bool Settings::readSettings(const QString &filename)
     m_notes_per_staff = static_cast<int>(readNumber("notesPerStaff"));
     m_staffs_per_page = static_cast<int>(readNumber("staffsPerPage"));
     m_dpi = static_cast<int>(readNumber("dpi"));
+    m_lilypond_servers = static_cast<int>(readNumber("lilypondServers"));
     m_confidence_coefficient = static_cast<float>(readNumber("confidenceCoefficient"));
     m_confidence_shift = static_cast<float>(readNumber("confidenceShift"));
+    m_reference_pitch = static_cast<float>(readNumber("referencePitch"));
+    m_pitch_hysteresis = static_cast<float>(readNumber("pitchHysteresis"));
     m_lilypond_working_directory = readString("lilypondWorkingDirectory");
+    QString score_format = readString("scoreFormat");
+    m_vector_score = score_format == "svg";
+    QString page_turn_mode = readString("pageTurnMode");
+    m_half_page_turn = page_turn_mode == "half";
+    m_page_turn_lead_time = static_cast<float>(readNumber("pageTurnLeadTime"));
     m_lilypond_header = readString("lilypondHeader");
     m_lilypond_footer = readString("lilypondFooter");
+    m_metrics_port = static_cast<int>(readNumber("metricsPort"));
+    m_web_socket_port = static_cast<int>(readNumber("webSocketPort"));
+    m_output_interval = static_cast<int>(readNumber("outputInterval"));
 
     if (readNotes() == false) {
         qWarning() << "Failed to read \"notes\".";
         m_status = false;
     }
+    if (m_input_channels < 1) {
+        qWarning().nospace() << "Input channels must be positive. Read value: " << m_input_channels << ".";
+        m_status = false;
+    } else if (readChannelParts() == false) {
+        qWarning() << "Failed to read \"channelParts\", expected array of { \"channels\": [ ... ], \"part\": n }"
+                      " with channels below inputChannels.";
+        m_status = false;
+    }
     if (readIndicatorXPositions() == false) {
         qWarning() << "Failed to read \"indicatorXPositions\".";
         m_status = false;
     }
+    if (readOscTargets() == false) {
+        qWarning() << "Failed to read \"oscTargets\", expected array of \"host:port\".";
+        m_status = false;
+    }
+
+    if (score_format != "png" && score_format != "svg") {
+        qWarning().nospace() << "Score format must be png or svg. Read value: " << score_format << ".";
+        m_status = false;
+    }
+
+    if (page_turn_mode != "full" && page_turn_mode != "half") {
+        qWarning().nospace() << "Page turn mode must be full or half. Read value: " << page_turn_mode << ".";
+        m_status = false;
+    }
+
+    if (m_reference_pitch <= 0) {
+        qWarning().nospace() << "Reference pitch must be positive. Read value: " << m_reference_pitch << ".";
+        m_status = false;
+    }
+
+    if (m_pitch_hysteresis < 0 || m_pitch_hysteresis >= 50) {
+        qWarning().nospace() << "Pitch hysteresis must be from 0 to 50 cents. Read value: " << m_pitch_hysteresis << ".";
+        m_status = false;
+    }
+
+    if (m_metrics_port < 0 || m_metrics_port > 65535) {
+        qWarning().nospace() << "Metrics port must be from 0 to 65535. Read value: " << m_metrics_port << ".";
+        m_status = false;
+    }
+
+    if (m_web_socket_port < 0 || m_web_socket_port > 65535) {
+        qWarning().nospace() << "Web socket port must be from 0 to 65535. Read value: " << m_web_socket_port << ".";
+        m_status = false;
+    }
+
+    if (m_output_interval < 1) {
+        qWarning().nospace() << "Output interval must be positive. Read value: " << m_output_interval << ".";
+        m_status = false;
+    }
 
     if (m_frame_size % 2 == 1) {
         qWarning().nospace() << "Frame size cannot be odd. Read value: " << m_frame_size << ".";
@@ -124,7 +198,6 @@ bool Settings::readNotes()
         return false;
 
     QJsonArray notes = m_root.value("notes").toArray();
-    QVector<float> frequency(notes.size());
     m_minimal_confidence.fill(0, notes.size());
     m_lilypond_notes_notation.fill("", notes.size());
 
@@ -135,7 +208,6 @@ bool Settings::readNotes()
         if (!row[0].isDouble() || !row[1].isDouble() || !row[2].isDouble() || !row[3].isString()) // check if row is correct
             return false;
         int number = static_cast<int>(row[0].toDouble());
-        frequency[number] = static_cast<float>(row[1].toDouble());
         m_minimal_confidence[number] = static_cast<float>(row[2].toDouble());
         if (m_minimal_confidence[number] == 0.f) {
             m_minimal_confidence[number] = 1;
@@ -146,16 +218,6 @@ bool Settings::readNotes()
         m_lilypond_notes_notation[number] = row[3].toString();
     }
 
-    // calc notes frequency boundries
-    float last_boundry = 0;
-    m_notes_frequency_boundry.clear();
-    for (int i = 1; i < frequency.size(); i++) {
-        float boundry = std::sqrt(frequency[i - 1] * frequency[i]);
-        m_notes_frequency_boundry.push_back({ last_boundry, boundry });
-        last_boundry = boundry;
-    }
-    m_notes_frequency_boundry.push_back({ last_boundry, std::numeric_limits<float>::max() });
-
     return true;
 }
 
@@ -181,6 +243,51 @@ bool Settings::readIndicatorXPositions()
     return true;
 }
 
+bool Settings::readChannelParts()
+{
+    if (m_root.value("channelParts").isArray() == false)
+        return false;
+
+    QJsonArray channel_parts = m_root.value("channelParts").toArray();
+    m_channel_parts.clear();
+    for (auto it : channel_parts) {
+        const QJsonObject object = it.toObject();
+        if (object.value("channels").isArray() == false || object.value("part").isDouble() == false)
+            return false;
+
+        ChannelPart channel_part;
+        channel_part.part = object.value("part").toInt();
+        for (auto channel : object.value("channels").toArray()) {
+            if (channel.isDouble() == false || channel.toInt() < 0 || channel.toInt() >= m_input_channels)
+                return false;
+            channel_part.channels.push_back(channel.toInt());
+        }
+        if (channel_part.channels.isEmpty() || channel_part.part < 0)
+            return false;
+        m_channel_parts.push_back(channel_part);
+    }
+
+    return !m_channel_parts.isEmpty();
+}
+
+bool Settings::readOscTargets()
+{
+    if (m_root.value("oscTargets").isArray() == false)
+        return false;
+
+    QJsonArray targets = m_root.value("oscTargets").toArray();
+    m_osc_targets.clear();
+    for (auto it : targets) {
+        const QString target = it.toString();
+        const int port = target.mid(target.lastIndexOf(':') + 1).toInt();
+        if (target.lastIndexOf(':') < 1 || port < 1 || port > 65535)
+            return false;
+        m_osc_targets.push_back(target);
+    }
+
+    return true;
+}
+
 bool Settings::verbose() const
 {
     return m_verbose;
@@ -196,6 +303,11 @@ int Settings::sampleRate() const
     return m_sample_rate;
 }
 
+int Settings::inputChannels() const
+{
+    return m_input_channels;
+}
+
 int Settings::frameSize() const
 {
     return m_frame_size;
@@ -216,6 +328,16 @@ float Settings::confidenceShift() const
     return m_confidence_shift;
 }
 
+float Settings::referencePitch() const
+{
+    return m_reference_pitch;
+}
+
+float Settings::pitchHysteresis() const
+{
+    return m_pitch_hysteresis;
+}
+
 int Settings::indicatorWidth() const
 {
     return m_indicator_width;
@@ -246,14 +368,44 @@ int Settings::dpi() const
     return m_dpi;
 }
 
-const QVector<float>& Settings::minimalConfidence() const
+int Settings::lilypondServers() const
 {
-    return m_minimal_confidence;
+    return m_lilypond_servers;
+}
+
+bool Settings::vectorScore() const
+{
+    return m_vector_score;
+}
+
+bool Settings::halfPageTurn() const
+{
+    return m_half_page_turn;
+}
+
+float Settings::pageTurnLeadTime() const
+{
+    return m_page_turn_lead_time;
+}
+
+int Settings::metricsPort() const
+{
+    return m_metrics_port;
+}
+
+int Settings::webSocketPort() const
+{
+    return m_web_socket_port;
+}
+
+int Settings::outputInterval() const
+{
+    return m_output_interval;
 }
 
-const QVector<QPair<float, float>>& Settings::notesFrequencyBoundry() const
+const QVector<float>& Settings::minimalConfidence() const
 {
-    return m_notes_frequency_boundry;
+    return m_minimal_confidence;
 }
 
 const QString& Settings::lilypondWorkingDirectory() const
@@ -271,6 +423,11 @@ const QString &Settings::lilypondFooter() const
     return m_lilypond_footer;
 }
 
+const QVector<ChannelPart>& Settings::channelParts() const
+{
+    return m_channel_parts;
+}
+
 const QVector<int>& Settings::indicatorXs() const
 {
     return m_indicator_xs;
@@ -280,3 +437,50 @@ const QVector<QString>& Settings::lilypondNotesNotation() const
 {
     return m_lilypond_notes_notation;
 }
+
+const QVector<QString>& Settings::oscTargets() const
+{
+    return m_osc_targets;
+}
+
+void SettingsSource::publish(const SettingsPointer &settings)
+{
+    const quint64 generation = m_generation.load(std::memory_order_relaxed) + 1;
+    m_published.emplace_back(generation, settings);
+    std::atomic_store(&m_snapshot, settings);
+    m_latest.store(settings.get(), std::memory_order_relaxed);
+    m_generation.store(generation, std::memory_order_release); // publishes pointer above
+    retire();
+}
+
+void SettingsSource::retire()
+{
+    // reader loads generation before pointer, so the pointer it uses is never older than its acknowledgement
+    quint64 oldest_used = m_generation.load(std::memory_order_relaxed);
+    for (const auto &acknowledged : m_acknowledged)
+        oldest_used = qMin(oldest_used, acknowledged.load(std::memory_order_acquire));
+    while (!m_published.empty() && m_published.front().first < oldest_used)
+        m_published.pop_front();
+}
+
+int SettingsSource::addReader()
+{
+    m_acknowledged.emplace_back(0);
+    return static_cast<int>(m_acknowledged.size()) - 1;
+}
+
+const Settings *SettingsSource::latest(quint64 &generation) const
+{
+    generation = m_generation.load(std::memory_order_acquire);
+    return m_latest.load(std::memory_order_acquire);
+}
+
+void SettingsSource::acknowledge(int reader, quint64 generation)
+{
+    m_acknowledged[static_cast<size_t>(reader)].store(generation, std::memory_order_release);
+}
+
+SettingsPointer SettingsSource::snapshot() const
+{
+    return std::atomic_load(&m_snapshot);
+}
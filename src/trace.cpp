@@ -0,0 +1,119 @@
+// Author:  Jakub Precht
+
+#include "trace.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMutex>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QThread>
+
+struct Trace::ThreadEvents
+{
+    struct Event
+    {
+        const char *name;
+        qint64 begin; // ns
+        qint64 end;
+    };
+
+    QString thread_name;
+    std::atomic<int> count { 0 }; // written only by owning thread, after the event itself
+    std::atomic<int> dropped { 0 };
+    Event events[m_capacity];
+};
+
+QMutex Trace::m_registry_mutex;
+QVector<Trace::ThreadEvents *> Trace::m_registry;
+std::atomic<bool> Trace::m_enabled { false };
+qint64 Trace::m_start_time = 0;
+const int Trace::m_capacity;
+
+Trace::ThreadEvents &Trace::threadEvents()
+{
+    thread_local ThreadEvents *events = nullptr;
+    if (events == nullptr) {
+        // worker threads are named by controller, render thread of quick is known by its class
+        events = new ThreadEvents();
+        QThread *thread = QThread::currentThread();
+        QMutexLocker locker(&m_registry_mutex);
+        if (QCoreApplication::instance() != nullptr && thread == QCoreApplication::instance()->thread())
+            events->thread_name = "gui";
+        else if (!thread->objectName().isEmpty())
+            events->thread_name = thread->objectName();
+        else if (qstrcmp(thread->metaObject()->className(), "QThread") != 0)
+            events->thread_name = thread->metaObject()->className();
+        else
+            events->thread_name = QString("thread %1").arg(m_registry.size());
+        m_registry.push_back(events);
+    }
+    return *events;
+}
+
+void Trace::start()
+{
+    m_start_time = Latency::now();
+    m_enabled.store(true, std::memory_order_release);
+}
+
+void Trace::complete(const char *name, qint64 begin, qint64 end)
+{
+    ThreadEvents &events = threadEvents();
+    const int count = events.count.load(std::memory_order_relaxed);
+    if (count == m_capacity) {
+        events.dropped.store(events.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    events.events[count] = { name, begin, end };
+    events.count.store(count + 1, std::memory_order_release); // publishes the event to stop
+}
+
+bool Trace::stop(const QString &filename)
+{
+    m_enabled.store(false, std::memory_order_relaxed);
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "Failed to open: " << filename;
+        return false;
+    }
+
+    auto escaped = [](QString text) {
+        return text.replace('\\', "\\\\").replace('"', "\\\"");
+    };
+
+    // complete events ("X") with times in microseconds since start, threads named by metadata events
+    QTextStream out(&file);
+    const qint64 pid = QCoreApplication::applicationPid();
+    int dropped = 0;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    QMutexLocker locker(&m_registry_mutex);
+    for (int tid = 0; tid < m_registry.size(); tid++) {
+        const ThreadEvents &events = *m_registry[tid];
+        out << (tid > 0 ? ",\n" : "\n")
+            << QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%1,\"tid\":%2,\"args\":{\"name\":\"%3\"}}")
+               .arg(pid).arg(tid).arg(escaped(events.thread_name));
+
+        const int count = events.count.load(std::memory_order_acquire);
+        for (int i = 0; i < count; i++) {
+            const ThreadEvents::Event &event = events.events[i];
+            out << QString(",\n{\"name\":\"%1\",\"ph\":\"X\",\"pid\":%2,\"tid\":%3,\"ts\":%4,\"dur\":%5}")
+                   .arg(escaped(event.name)).arg(pid).arg(tid)
+                   .arg((event.begin - m_start_time) / 1000., 0, 'f', 3)
+                   .arg((event.end - event.begin) / 1000., 0, 'f', 3);
+        }
+        dropped += events.dropped.load(std::memory_order_relaxed);
+    }
+    out << "\n]}\n";
+    out.flush();
+
+    if (!file.commit()) {
+        qWarning() << "Failed to write: " << filename;
+        return false;
+    }
+    if (dropped > 0)
+        qWarning().nospace() << dropped << " trace events were dropped, buffers of their threads were full.";
+    qInfo().nospace() << "Trace written to " << filename << ".";
+    return true;
+}